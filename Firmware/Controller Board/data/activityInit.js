@@ -1,61 +1,195 @@
-print("hiiii");
+// Shared by every activity, run once per heap before the activity's own script.
+//
+// Elements are native objects. `activity` is the root, and each element has:
+//   value, x, y, width, height, index  attribute accessors, as strings
+//   getAttribute(name), setAttribute(name, value)  for any other attribute
+//   setAttributes({name: value, ...})  several at once, one update for the renderer
+//   children  its child elements; assigning an array of
+//             {type, key, attributes, children} descriptions reconciles them,
+//             see reconcile() below
+//   removeChild(child)  takes child out of the tree for good, its object and
+//                       those under it stop working
+//   moveChild(child, index)  moves child to position index among the children
+//   attributes  the element itself, for scripts written against the old proxy
+// createElement(parent, type) adds a single child and returns it.
+// setAttributes(element, {...}) is the same as element.setAttributes({...}).
+// batch(fn) runs fn and holds everything it changes back until it returns, so
+// the display shows all of it in the same frame.
+// requestAnimationFrame(cb) calls cb(elapsed ms) once, after the next frame
+// is shown, and returns an id for cancelAnimationFrame(id). Callbacks, and
+// onFramePresented(frame, time_since_submit), are aborted if they run over
+// their time budget.
+// setTimeout(cb, ms) and setInterval(cb, ms) return an id for clearTimeout(id)
+// or clearInterval(id). Callbacks that come due together run together at the
+// next frame, so an interval runs at most once a frame, and a script waiting
+// on nothing but timers isn't woken between them.
+
+// What the last reconcile() made an element from, kept out of enumeration
+function layoutOf(element) {
+  return element.__layout;
+}
+
+function setLayout(element, type, key, attributes) {
+  Object.defineProperty(element, "__layout", {
+    value: {type: type, key: key, attributes: attributes},
+    writable: true,
+    configurable: true
+  });
+}
 
-const attrHandler = {
-  get: function(target, prop, receiver) {
-    return getAttribute(target.pointer, prop);
-  },
-  set: function(target, prop, value, receiver) {
-    setAttribute(target.pointer, prop, value)
-    return;
-  }
-};
-
-function Child(type, pointer, children, attributes) {
-  this.type = type;
-  this.pointer = pointer;
-  this._children = [];
-  this.children = children;
-  this.attributes = new Proxy(this, attrHandler);
-  var entries = Object.keys(attributes);
-  var i, n;
-  for (i = 0, n = entries.length; i < n; i++) {
-    print(i.toString());
-    this.attributes[entries[i]] = attributes[entries[i]];
+function layoutKey(description) {
+  return description.key === undefined || description.key === null ? undefined : String(description.key);
+}
+
+// Attributes from a description, as the strings the element stores
+function layoutAttributes(description) {
+  var attributes = {};
+  var source = description.attributes || {};
+  for (var name in source) {
+    if (source.hasOwnProperty(name)) {
+      attributes[name] = String(source[name]);
+    }
   }
+  return attributes;
 }
 
-Child.prototype = {
-  set children(children) {
-    var i, n;
-    for (i = 0, n = children.length; i < n; i++) {
-      this._children.push(
-        new Child(
-          children[i].type,
-          createElement(this.pointer, children[i].type),
-          children[i].children,
-          children[i].attributes
-        )
-      );
-    }
-  }
-};
-
-const activity = {
-  _children: [],
-  set children(children) {
-    var i, n;
-    for (i = 0, n = children.length; i < n; i++) {
-      this._children.push(
-        new Child(
-          children[i].type,
-          createElement(objectPointer, children[i].type),
-          children[i].children,
-          children[i].attributes
-        )
-      );
-    }
-  },
-  get children(children) {
-    return this._children;
-  }
-}
\ No newline at end of file
+// Positions in sequence (-1s skipped) that form its longest increasing run - those children can stay put
+function stablePositions(sequence) {
+  var tails = [];     // position of the smallest tail of each run length
+  var previous = [];
+  for (var i = 0; i < sequence.length; i++) {
+    if (sequence[i] < 0) {
+      continue;
+    }
+    var low = 0;
+    var high = tails.length;
+    while (low < high) {
+      var middle = (low + high) >> 1;
+      if (sequence[tails[middle]] < sequence[i]) {
+        low = middle + 1;
+      } else {
+        high = middle;
+      }
+    }
+    previous[i] = low > 0 ? tails[low - 1] : -1;
+    tails[low] = i;
+  }
+  var stable = [];
+  for (var at = tails.length ? tails[tails.length - 1] : -1; at >= 0; at = previous[at]) {
+    stable[at] = true;
+  }
+  return stable;
+}
+
+function reconcileChildren(parent, layout) {
+  var old = parent.children.slice();
+  var keyed = {};
+  var unkeyed = {};  // type -> old positions, in order
+  var i, layoutState, description, key, type, match;
+
+  for (i = 0; i < old.length; i++) {
+    layoutState = layoutOf(old[i]);
+    if (!layoutState) {
+      continue;  // made with createElement, not by a layout
+    }
+    if (layoutState.key !== undefined) {
+      keyed[layoutState.type + "\u0000" + layoutState.key] = i;
+    } else {
+      (unkeyed[layoutState.type] = unkeyed[layoutState.type] || []).push(i);
+    }
+  }
+
+  // Same type and key, or without keys the same type in the same order
+  var matched = [];
+  var used = [];
+  var unkeyedNext = {};
+  for (i = 0; i < layout.length; i++) {
+    description = layout[i];
+    type = description.type;
+    key = layoutKey(description);
+    match = -1;
+    if (key !== undefined) {
+      if (keyed.hasOwnProperty(type + "\u0000" + key)) {
+        match = keyed[type + "\u0000" + key];
+        delete keyed[type + "\u0000" + key];  // a repeated key gets a new element
+      }
+    } else if (unkeyed[type]) {
+      var next = unkeyedNext[type] || 0;
+      if (next < unkeyed[type].length) {
+        match = unkeyed[type][next];
+        unkeyedNext[type] = next + 1;
+      }
+    }
+    matched[i] = match;
+    if (match >= 0) {
+      used[match] = true;
+    }
+  }
+
+  for (i = 0; i < old.length; i++) {
+    if (!used[i]) {
+      parent.removeChild(old[i]);
+    }
+  }
+
+  // Kept elements get only the attributes that changed, new ones are appended. Children go first, so
+  // an attribute that refers to them, like a menu's index, arrives once they are there
+  var children = [];
+  for (i = 0; i < layout.length; i++) {
+    description = layout[i];
+    var attributes = layoutAttributes(description);
+    var child;
+    var changed = null;
+    if (matched[i] >= 0) {
+      child = old[matched[i]];
+      var previous = layoutOf(child).attributes;
+      for (var name in attributes) {
+        if (attributes.hasOwnProperty(name) && previous[name] !== attributes[name]) {
+          (changed = changed || {})[name] = attributes[name];
+        }
+      }
+    } else {
+      child = createElement(parent, description.type);
+      changed = attributes;
+    }
+    reconcileChildren(child, description.children || []);
+    if (changed) {
+      child.setAttributes(changed);
+    }
+    setLayout(child, description.type, layoutKey(description), attributes);
+    children[i] = child;
+  }
+
+  // Back to front, everything off the longest run that is already in order goes in front of its successor
+  var stable = stablePositions(matched);
+  var current = parent.children;  // kept in step by the natives
+  var successor = null;
+  for (i = children.length - 1; i >= 0; i--) {
+    if (!stable[i]) {
+      var from = current.indexOf(children[i]);
+      var to = successor ? current.indexOf(successor) : current.length;
+      if (from < to) {
+        to--;
+      }
+      if (from !== to) {
+        parent.moveChild(children[i], to);
+      }
+    }
+    successor = children[i];
+  }
+}
+
+// reconcile(parent, layout) makes parent's children match layout, an array of
+// {type, key, attributes, children} descriptions, the same way at every level.
+// Children made by an earlier layout are kept when type and key match, or for
+// descriptions without a key, type and order among the unkeyed ones. Kept
+// children only get the attributes that differ from their last description,
+// the rest are removed or created and the order fixed with the fewest moves,
+// all in one batch. Attributes a description leaves out keep their value.
+function reconcile(parent, layout) {
+  batch(function () {
+    reconcileChildren(parent, layout || []);
+  });
+}
+
+print("hiiii");
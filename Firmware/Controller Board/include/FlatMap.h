@@ -0,0 +1,84 @@
+/*
+
+  FlatMap.h - Sorted key/value array with the interface of a small std::map.
+
+  Lookups are a binary search over a SmallVector, so the first N entries
+  live inside the owning object instead of in one tree node each.
+
+*/
+
+#ifndef FlatMap_h
+#define FlatMap_h
+
+#include "SmallVector.h"
+
+template <typename K, typename V, size_t N>
+class FlatMap {
+
+public:
+  typedef std::pair<K, V> value_type;
+  typedef value_type* iterator;
+  typedef const value_type* const_iterator;
+
+private:
+  SmallVector<value_type, N> items;
+
+  template <typename Q>
+  iterator lowerBound(const Q& key) {
+    return std::lower_bound(items.begin(), items.end(), key,
+      [](const value_type& item, const Q& key) { return item.first < key; });
+  }
+
+public:
+  size_t size() const { return items.size(); }
+  bool empty() const { return items.empty(); }
+
+  iterator begin() { return items.begin(); }
+  iterator end() { return items.end(); }
+  const_iterator begin() const { return items.begin(); }
+  const_iterator end() const { return items.end(); }
+
+  // Keys compare against anything std::string does, so lookups by literal don't build a string
+  template <typename Q>
+  iterator find(const Q& key) {
+    iterator item = lowerBound(key);
+    if (item != items.end() && !(key < item->first)) {
+      return item;
+    }
+    return items.end();
+  }
+
+  template <typename Q>
+  size_t count(const Q& key) {
+    return find(key) != items.end() ? 1 : 0;
+  }
+
+  template <typename Q>
+  V& operator[](const Q& key) {
+    iterator item = lowerBound(key);
+    if (item == items.end() || key < item->first) {
+      item = items.insert(item, value_type(K(key), V()));
+    }
+    return item->second;
+  }
+
+  template <typename Q>
+  size_t erase(const Q& key) {
+    iterator item = find(key);
+    if (item == items.end()) {
+      return 0;
+    }
+    items.erase(item);
+    return 1;
+  }
+
+  void clear() {
+    items.clear();
+  }
+
+  size_t heapBytes() const {
+    return items.heapBytes();
+  }
+};
+
+#endif
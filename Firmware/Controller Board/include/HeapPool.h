@@ -0,0 +1,170 @@
+/*
+
+  HeapPool.h - Size class allocator over one fixed region, for a Duktape heap.
+
+  Blocks are powers of two from 16 bytes, each with an 8 byte header, cut
+  from the region with a bump pointer and kept on a free list per size
+  class once freed. Nothing is ever returned to the system heap until the
+  whole pool goes, so a long running script can't fragment it, and the
+  region is a hard cap on what the script can use. Only ever used from
+  one task, so there is no locking.
+
+*/
+
+#ifndef HeapPool_h
+#define HeapPool_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <esp_heap_caps.h>
+
+#define HEAP_POOL_MIN_SHIFT 4  // 16 byte blocks, 8 of them header
+#define HEAP_POOL_CLASSES 24
+
+class HeapPool {
+
+  struct BlockHeader {
+    uint32_t sizeClass;
+    uint32_t requested;
+  };
+
+  struct FreeBlock {
+    FreeBlock* next;
+  };
+
+  uint8_t* region;
+  size_t capacity = 0;
+  size_t used = 0;  // bump pointer
+  FreeBlock* freeLists[HEAP_POOL_CLASSES] = {nullptr};
+
+  static uint8_t sizeClassFor(size_t size) {
+    size += sizeof(BlockHeader);
+    uint8_t sizeClass = 0;
+    while (sizeClass < HEAP_POOL_CLASSES && blockSize(sizeClass) < size) {
+      sizeClass ++;
+    }
+    return sizeClass;
+  }
+
+  static size_t blockSize(uint8_t sizeClass) {
+    return (size_t)1 << (sizeClass + HEAP_POOL_MIN_SHIFT);
+  }
+
+public:
+
+  size_t inUse = 0;       // bytes in live blocks, headers included
+  size_t peak = 0;
+  uint32_t failures = 0;  // allocations refused at the cap
+  bool inPsram = false;
+
+  HeapPool(size_t size, bool psram) {
+    region = nullptr;
+    if (psram) {
+      region = (uint8_t*)heap_caps_malloc(size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+      inPsram = region != nullptr;
+    }
+    if (!region) {
+      region = (uint8_t*)heap_caps_malloc(size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    }
+    if (region) {
+      capacity = size;
+    }
+  }
+
+  ~HeapPool() {
+    heap_caps_free(region);  // every block at once
+  }
+
+  size_t getCapacity() {
+    return capacity;
+  }
+
+  // Every block, and so every pointer handed out, is 8 byte aligned from here
+  const uint8_t* base() const {
+    return region;
+  }
+
+  void* allocate(size_t size) {
+    if (size == 0) {
+      return nullptr;
+    }
+    uint8_t sizeClass = sizeClassFor(size);
+    if (sizeClass >= HEAP_POOL_CLASSES) {
+      failures ++;
+      return nullptr;
+    }
+    BlockHeader* block;
+    if (freeLists[sizeClass]) {
+      block = (BlockHeader*)freeLists[sizeClass];
+      freeLists[sizeClass] = freeLists[sizeClass]->next;
+    } else if (used + blockSize(sizeClass) <= capacity) {
+      block = (BlockHeader*)(region + used);
+      used += blockSize(sizeClass);
+    } else {
+      failures ++;  // Duktape collects garbage and tries again before giving up
+      return nullptr;
+    }
+    block->sizeClass = sizeClass;
+    block->requested = size;
+    inUse += blockSize(sizeClass);
+    if (inUse > peak) {
+      peak = inUse;
+    }
+    return block + 1;
+  }
+
+  void release(void* pointer) {
+    if (!pointer) {
+      return;
+    }
+    BlockHeader* block = (BlockHeader*)pointer - 1;
+    uint8_t sizeClass = block->sizeClass;
+    inUse -= blockSize(sizeClass);
+    FreeBlock* free = (FreeBlock*)block;
+    free->next = freeLists[sizeClass];
+    freeLists[sizeClass] = free;
+  }
+
+  void* reallocate(void* pointer, size_t size) {
+    if (!pointer) {
+      return allocate(size);
+    }
+    if (size == 0) {
+      release(pointer);
+      return nullptr;
+    }
+    BlockHeader* block = (BlockHeader*)pointer - 1;
+    uint8_t sizeClass = sizeClassFor(size);
+    if (sizeClass == block->sizeClass || sizeClass + 1u == block->sizeClass) {
+      block->requested = size;  // within a factor of two, not worth moving
+      return pointer;
+    }
+    void* moved = allocate(size);
+    if (!moved) {
+      if (sizeClass < block->sizeClass) {
+        block->requested = size;  // a shrink can always stay put
+        return pointer;
+      }
+      return nullptr;  // the old block stays valid, as realloc() promises
+    }
+    memcpy(moved, pointer, block->requested < size ? block->requested : size);
+    release(pointer);
+    return moved;
+  }
+
+  // Duktape allocation functions, with the pool as udata
+  static void* dukAlloc(void* udata, size_t size) {
+    return ((HeapPool*)udata)->allocate(size);
+  }
+
+  static void* dukRealloc(void* udata, void* pointer, size_t size) {
+    return ((HeapPool*)udata)->reallocate(pointer, size);
+  }
+
+  static void dukFree(void* udata, void* pointer) {
+    ((HeapPool*)udata)->release(pointer);
+  }
+};
+
+#endif
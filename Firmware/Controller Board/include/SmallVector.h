@@ -0,0 +1,121 @@
+/*
+
+  SmallVector.h - Vector with inline storage for its first N items.
+
+  Element trees are mostly small nodes with a handful of children, so
+  keeping those in the node itself saves a heap block per node and keeps
+  internal RAM from fragmenting. Past N items it moves everything to the
+  heap and behaves like std::vector.
+
+*/
+
+#ifndef SmallVector_h
+#define SmallVector_h
+
+#include <stddef.h>
+#include <new>
+#include <utility>
+#include <algorithm>
+
+template <typename T, size_t N>
+class SmallVector {
+
+  alignas(T) unsigned char inlineStorage[N * sizeof(T)];
+  T* items = reinterpret_cast<T*>(inlineStorage);
+  size_t count = 0;
+  size_t allocated = N;
+
+  bool onHeap() const {
+    return items != reinterpret_cast<const T*>(inlineStorage);
+  }
+
+  void grow(size_t capacity) {
+    T* moved = static_cast<T*>(::operator new(capacity * sizeof(T)));
+    for (size_t i = 0; i < count; i++) {
+      new (&moved[i]) T(std::move(items[i]));
+      items[i].~T();
+    }
+    if (onHeap()) {
+      ::operator delete(items);
+    }
+    items = moved;
+    allocated = capacity;
+  }
+
+public:
+  typedef T* iterator;
+  typedef const T* const_iterator;
+
+  SmallVector() {}
+
+  SmallVector(const SmallVector&) = delete;
+  SmallVector& operator=(const SmallVector&) = delete;
+
+  ~SmallVector() {
+    clear();
+    if (onHeap()) {
+      ::operator delete(items);
+    }
+  }
+
+  size_t size() const { return count; }
+  size_t capacity() const { return allocated; }
+  bool empty() const { return count == 0; }
+
+  iterator begin() { return items; }
+  iterator end() { return items + count; }
+  const_iterator begin() const { return items; }
+  const_iterator end() const { return items + count; }
+
+  T& operator[](size_t i) { return items[i]; }
+  const T& operator[](size_t i) const { return items[i]; }
+  T& back() { return items[count - 1]; }
+
+  void reserve(size_t capacity) {
+    if (capacity > allocated) {
+      grow(capacity);
+    }
+  }
+
+  template <typename... Args>
+  T& emplace_back(Args&&... args) {
+    if (count == allocated) {
+      T value(std::forward<Args>(args)...);  // args may refer to an item, build it before they move
+      grow(allocated * 2);
+      new (&items[count]) T(std::move(value));
+    } else {
+      new (&items[count]) T(std::forward<Args>(args)...);
+    }
+    return items[count++];
+  }
+
+  void push_back(const T& value) { emplace_back(value); }
+  void push_back(T&& value) { emplace_back(std::move(value)); }
+
+  iterator insert(const_iterator position, T&& value) {
+    size_t index = position - items;
+    emplace_back(std::move(value));
+    std::rotate(items + index, items + count - 1, items + count);
+    return items + index;
+  }
+
+  iterator erase(const_iterator position) {
+    size_t index = position - items;
+    std::move(items + index + 1, items + count, items + index);
+    items[--count].~T();
+    return items + index;
+  }
+
+  void clear() {
+    while (count) {
+      items[--count].~T();
+    }
+  }
+
+  // Bytes held outside the object itself
+  size_t heapBytes() const {
+    return onHeap() ? allocated * sizeof(T) : 0;
+  }
+};
+
+#endif
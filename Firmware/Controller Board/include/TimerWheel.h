@@ -0,0 +1,254 @@
+/*
+
+  TimerWheel.h - Hierarchical timer wheel, run by one worker task.
+
+  Four levels of 64 slots at a 1 ms tick reach about four and a half hours
+  ahead; anything further out waits in the top level and is placed again
+  each time its slot comes round. Timers are linked into their slot, so
+  starting or cancelling one is a list link or unlink however many are
+  pending. Ticks are read from esp_timer_get_time() rather than counted
+  from wakeups, so a worker that wakes late catches up instead of drifting,
+  and a periodic timer stays a whole number of periods from its start.
+
+  Callbacks run on the worker task one at a time, without the wheel's lock
+  held, so they may start and cancel timers themselves. Keep them short -
+  set a flag or post to a queue for the task that owns the work. Once
+  cancel() returns the callback isn't running, so the timer can be freed.
+
+*/
+
+#ifndef TimerWheel_h
+#define TimerWheel_h
+
+#include <Arduino.h>
+
+#define TIMER_WHEEL_TICK_US 1000
+#define TIMER_WHEEL_LEVELS 4
+#define TIMER_WHEEL_BITS 6
+#define TIMER_WHEEL_SLOTS (1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_STACK 4096
+
+// Intrusive list node, a list is a node linked to itself
+struct TimerLink {
+  TimerLink* prev = this;
+  TimerLink* next = this;
+
+  TimerLink() {}
+  TimerLink(const TimerLink&) = delete;
+  TimerLink& operator=(const TimerLink&) = delete;
+
+  bool linked() const {
+    return next != this;
+  }
+
+  void unlink() {
+    prev->next = next;
+    next->prev = prev;
+    prev = next = this;
+  }
+
+  // Called on a list's head, adds item at the tail
+  void append(TimerLink* item) {
+    item->prev = prev;
+    item->next = this;
+    prev->next = item;
+    prev = item;
+  }
+};
+
+// Owned by whoever starts it, and must outlive its time on the wheel
+class WheelTimer: public TimerLink {
+
+  friend class TimerWheel;
+
+  uint64_t expires = 0;  // wheel tick
+  uint32_t period = 0;   // ticks, 0 for a one shot
+
+public:
+  void (*callback)(void* arg);
+  void* arg;
+
+  WheelTimer(void (*callback)(void* arg), void* arg = nullptr): callback(callback), arg(arg) {}
+};
+
+class TimerWheel {
+
+  TimerLink slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+  uint64_t current = 0;  // next tick to run
+  int64_t epoch = 0;     // esp_timer_get_time() at tick 0
+  uint32_t pending = 0;
+  SemaphoreHandle_t lock = nullptr;
+  TaskHandle_t worker = nullptr;
+  WheelTimer* running = nullptr;  // callback in progress, cancel() waits it out
+
+  static uint8_t shift(uint8_t level) {
+    return TIMER_WHEEL_BITS * level;
+  }
+
+  // Level by distance, slot by expiry, so a slot holds every timer due in its span
+  void place(WheelTimer* timer) {
+    uint64_t when = timer->expires > current ? timer->expires : current;
+    uint64_t delta = when - current;
+    uint8_t level = 0;
+    while (level < TIMER_WHEEL_LEVELS - 1 && (delta >> shift(level + 1))) {
+      level ++;
+    }
+    if (delta >> shift(TIMER_WHEEL_LEVELS)) {
+      when = current + ((uint64_t)1 << shift(TIMER_WHEEL_LEVELS)) - 1;  // beyond the wheel, placed again later
+    }
+    slots[level][(when >> shift(level)) & (TIMER_WHEEL_SLOTS - 1)].append(timer);
+  }
+
+  // Called with the lock held, which is let go around each callback
+  void runTick() {
+    uint64_t tick = current;
+
+    // Spread the higher level slots that come due on this tick into the levels below
+    for (uint8_t level = TIMER_WHEEL_LEVELS - 1; level > 0; level --) {
+      if (tick & (((uint64_t)1 << shift(level)) - 1)) {
+        continue;
+      }
+      TimerLink& slot = slots[level][(tick >> shift(level)) & (TIMER_WHEEL_SLOTS - 1)];
+      while (slot.linked()) {
+        WheelTimer* timer = static_cast<WheelTimer*>(slot.next);
+        timer->unlink();
+        place(timer);
+      }
+    }
+
+    // Take the whole slot first, timers started from callbacks land in later ones
+    TimerLink due;
+    TimerLink& slot = slots[0][tick & (TIMER_WHEEL_SLOTS - 1)];
+    while (slot.linked()) {
+      TimerLink* item = slot.next;
+      item->unlink();
+      due.append(item);
+    }
+    current = tick + 1;
+
+    while (due.linked()) {
+      WheelTimer* timer = static_cast<WheelTimer*>(due.next);
+      timer->unlink();
+      if (timer->expires > tick) {
+        place(timer);  // was beyond the wheel
+        continue;
+      }
+      if (timer->period) {
+        timer->expires += timer->period;  // from when it was due, not when it ran
+        if (timer->expires < current) {   // the worker was held up, skip the missed periods
+          timer->expires += (current - timer->expires + timer->period - 1) / timer->period * timer->period;
+        }
+        place(timer);
+      } else {
+        pending --;
+      }
+      void (*callback)(void* arg) = timer->callback;
+      void* arg = timer->arg;
+      running = timer;
+      xSemaphoreGive(lock);
+      callback(arg);
+      xSemaphoreTake(lock, portMAX_DELAY);
+      running = nullptr;
+    }
+  }
+
+  // Ticks from current until the worker next has something to do
+  uint32_t idleTicks() {
+    for (uint32_t i = 0; i < TIMER_WHEEL_SLOTS; i ++) {
+      uint64_t tick = current + i;
+      if (slots[0][tick & (TIMER_WHEEL_SLOTS - 1)].linked()) {
+        return i;
+      }
+      if (!(tick & (TIMER_WHEEL_SLOTS - 1))) {
+        return i;  // a cascade
+      }
+    }
+    return TIMER_WHEEL_SLOTS;
+  }
+
+  static void workerTask(void* arg) {
+    TimerWheel* wheel = (TimerWheel*)arg;
+    while (true) {
+      uint64_t now = wheel->clockTicks();
+      xSemaphoreTake(wheel->lock, portMAX_DELAY);
+      if (!wheel->pending && wheel->current <= now) {
+        wheel->current = now + 1;  // nothing to run, nothing to catch up on
+      }
+      while (wheel->current <= now) {
+        wheel->runTick();
+      }
+      TickType_t wait = portMAX_DELAY;
+      if (wheel->pending) {
+        uint64_t target = wheel->current + wheel->idleTicks();
+        now = wheel->clockTicks();
+        wait = target > now ? pdMS_TO_TICKS((target - now) * TIMER_WHEEL_TICK_US / 1000) : 0;
+        if (!wait) {
+          wait = 1;
+        }
+      }
+      xSemaphoreGive(wheel->lock);
+      ulTaskNotifyTake(pdTRUE, wait);  // woken early when a timer is started
+    }
+  }
+
+public:
+
+  void begin(UBaseType_t priority, BaseType_t core) {
+    epoch = esp_timer_get_time();
+    lock = xSemaphoreCreateMutex();
+    xTaskCreatePinnedToCore(workerTask, "Timers", TIMER_WHEEL_STACK, this, priority, &worker, core);
+  }
+
+  // Ticks since begin, from the microsecond clock
+  uint64_t clockTicks() {
+    return (esp_timer_get_time() - epoch) / TIMER_WHEEL_TICK_US;
+  }
+
+  // Milliseconds since begin
+  uint64_t now() {
+    return clockTicks() * TIMER_WHEEL_TICK_US / 1000;
+  }
+
+  // Run callback delayMs from now, then every periodMs if that isn't 0 - restarts a pending timer
+  void start(WheelTimer& timer, uint32_t delayMs, uint32_t periodMs = 0) {
+    xSemaphoreTake(lock, portMAX_DELAY);
+    uint64_t now = clockTicks();
+    if (timer.linked()) {
+      timer.unlink();
+    } else {
+      if (!pending && current < now) {
+        current = now;  // an idle wheel stopped counting, it has no ticks to catch up on
+      }
+      pending ++;
+    }
+    timer.expires = now + (uint64_t)delayMs * 1000 / TIMER_WHEEL_TICK_US;
+    timer.period = (uint64_t)periodMs * 1000 / TIMER_WHEEL_TICK_US;
+    place(&timer);
+    xSemaphoreGive(lock);
+    xTaskNotifyGive(worker);
+  }
+
+  // The callback won't be called after this, and isn't running unless this is called from it
+  void cancel(WheelTimer& timer) {
+    xSemaphoreTake(lock, portMAX_DELAY);
+    if (timer.linked()) {
+      timer.unlink();
+      pending --;
+    }
+    while (running == &timer && xTaskGetCurrentTaskHandle() != worker) {
+      xSemaphoreGive(lock);
+      vTaskDelay(1);
+      xSemaphoreTake(lock, portMAX_DELAY);
+    }
+    xSemaphoreGive(lock);
+  }
+
+  bool isPending(WheelTimer& timer) {
+    xSemaphoreTake(lock, portMAX_DELAY);
+    bool linked = timer.linked();
+    xSemaphoreGive(lock);
+    return linked;
+  }
+};
+
+#endif
@@ -3102,6 +3102,57 @@ typedef struct duk_hthread duk_context;
 
 /* __OVERRIDE_DEFINES__ */
 
+/* Activity scripts are cached as bytecode in the data partition */
+#define DUK_USE_BYTECODE_DUMP_SUPPORT
+
+/* Script callbacks run under a time budget, checked against the heap udata */
+#define DUK_USE_INTERRUPT_COUNTER
+#define DUK_USE_EXEC_TIMEOUT_CHECK(udata) activityExecTimeout((udata))
+#if defined(__cplusplus)
+extern "C"
+#endif
+duk_bool_t activityExecTimeout(void *udata);
+
+/*
+ *  Build profiles.  The default keeps built-ins in RAM, which works with
+ *  plain Duktape sources.  FLIPDOT_DUK_LOWMEM (env:esp32dev_lowmem) keeps
+ *  built-ins and the window bindings in flash and compresses heap pointers
+ *  to 16 bits relative to the activity's HeapPool; it needs sources
+ *  prepared with configure.py --rom-support, which tools/duktape_lowmem.py
+ *  generates for that env.
+ */
+
+#if defined(FLIPDOT_DUK_LOWMEM)
+#define DUK_USE_ROM_OBJECTS
+#define DUK_USE_ROM_STRINGS
+#define DUK_USE_ROM_GLOBAL_INHERIT
+#undef DUK_USE_ROM_GLOBAL_CLONE
+
+#define DUK_USE_HEAPPTR16
+#define DUK_USE_HEAPPTR_ENC16(udata,ptr) activityHeapEnc16((udata),(ptr))
+#define DUK_USE_HEAPPTR_DEC16(udata,x) activityHeapDec16((udata),(x))
+#if defined(__cplusplus)
+extern "C" {
+#endif
+duk_uint16_t activityHeapEnc16(void *udata, void *ptr);
+void *activityHeapDec16(void *udata, duk_uint16_t val);
+#if defined(__cplusplus)
+}
+#endif
+
+#define DUK_USE_REFCOUNT16
+#undef DUK_USE_REFCOUNT32
+#define DUK_USE_STRHASH16
+#define DUK_USE_STRLEN16
+#define DUK_USE_BUFLEN16
+#define DUK_USE_OBJSIZES16
+#define DUK_USE_STRTAB_PTRCOMP
+#else
+#undef DUK_USE_ROM_OBJECTS
+#undef DUK_USE_ROM_STRINGS
+#undef DUK_USE_ROM_GLOBAL_INHERIT
+#endif
+
 /*
  *  Conditional includes
  */
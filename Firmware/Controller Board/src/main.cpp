@@ -3,37 +3,94 @@
 #include "Font4x5Fixed.h"
 
 #include <duktape.h>
+#include <LittleFS.h>
+#include <DisplayBackend.h>
+#include "SmallVector.h"
+#include "FlatMap.h"
+#include "HeapPool.h"
+#include "TimerWheel.h"
 
 #include <string>
 #include <vector>
-#include <map>
 #include <stdio.h>
 
 #define ANIMATION_SCALE 1
 
+// Activity scripts run in their own task, away from the display task on core 1
+#define ACTIVITY_TASK_CORE 0
+#define ACTIVITY_TASK_STACK 16384
+#define ACTIVITY_EVENT_QUEUE 8
+#define ACTIVITY_HEAP_SIZE (64 * 1024)  // hard cap on each activity's Duktape heap
+#define ACTIVITY_HEAP_PSRAM true         // place it in PSRAM when the board has some
+#define ACTIVITY_CALLBACK_BUDGET_US 8000 // longest a script callback may run before Duktape aborts it
+
+// Compiled scripts, one blob per script in the data partition, rebuilt when the source hash changes
+#define SCRIPT_CACHE_DIR "/cache"
+#ifdef FLIPDOT_DUK_LOWMEM  // 16 bit pointers and sizes, ROM strings - bytecode that won't load in the default build
+  #define SCRIPT_CACHE_MAGIC 0x4C424446  // "FDBL"
+#else
+  #define SCRIPT_CACHE_MAGIC 0x43424446  // "FDBC"
+#endif
+#define SCRIPT_CHUNK 512
+#define SCRIPT_PRELUDE "activityInit"  // shared by every activity, run once per heap
+
+// One timer wheel for everything that runs on a clock, its callbacks on one task
+#define TIMER_TASK_CORE 0
+#define TIMER_TASK_PRIORITY 2  // above activity scripts, so a busy script can't hold a deadline back
+
+TimerWheel timers;
+
+// Children and attributes held inside each element before spilling to the heap. An attribute slot is
+// 52 bytes, and the elements of data/test.main.js carry at most 3 (value, x, y) - memoryReport() marks any
+// element that spills
+#define ELEMENT_INLINE_CHILDREN 4
+#define ELEMENT_INLINE_ATTRIBUTES 3
+
+//#define OLED_DISPLAY  // mirror the flip dots on an SSD1306, needs adafruit/Adafruit SSD1306 in lib_deps
+
+#ifdef OLED_DISPLAY
+  #include <Wire.h>
+  #include <Adafruit_SSD1306.h>
+  Adafruit_SSD1306 oled(128, 32, &Wire, -1);
+  GFXMirrorBackend oledMirror(oled, [](){ oled.display(); });
+#endif
+
 #define INPUT_UP 32
 #define INPUT_DOWN 27
 #define INPUT_LEFT 25
 #define INPUT_RIGHT 33
 #define INPUT_CENTER 26
 
+#define FRAME_BUFFER_SIZE 40  // columns, and rows for the root, so a wall mounted on its side renders 7 x 40
+
+// One Column per x, as many rows as it has bits - uint8_t for nested containers, uint64_t at the root
+template <typename Column>
 class FrameBuffer {
 
 public:
-  uint8_t buffer[40] = {false};
+  static const uint8_t rows = sizeof(Column) * 8 < FRAME_BUFFER_SIZE ? sizeof(Column) * 8 : FRAME_BUFFER_SIZE;
+
+  Column buffer[FRAME_BUFFER_SIZE] = {0};
+
+  void clear() {
+    memset(buffer, 0, sizeof(buffer));
+  }
 
   void setPixel(uint8_t x, uint8_t y, bool val) {
-    if (x < 40 && y < 7) {
+    if (x < FRAME_BUFFER_SIZE && y < rows) {
       if (val) {
-        buffer[x] |= ((uint8_t)1 << y);
+        buffer[x] |= ((Column)1 << y);
       } else {
-        buffer[x] &= ~((uint8_t)1 << y);
+        buffer[x] &= ~((Column)1 << y);
       }
     }
   }
 
   bool getPixel(uint8_t x, uint8_t y) {
-    return (buffer[x] & (uint8_t)1 << y) >> y;
+    if (x >= FRAME_BUFFER_SIZE || y >= rows) {
+      return false;
+    }
+    return (buffer[x] >> y) & 1;
   }
 };
 
@@ -43,6 +100,11 @@ namespace window {
     uint16_t time_since_last_render;
   };
 
+  struct PresentParameters {
+    uint32_t frame;                 // counts frames submitted to the driver boards
+    uint16_t time_since_submit;     // ms from submission until the last dot latched
+  };
+
   struct AttributeValue {
     std::string value;
     bool update = true;
@@ -60,8 +122,29 @@ namespace window {
 
   public:
 
-    std::vector<Element*> children;
-    std::map<std::string, AttributeValue> attributes;
+    SmallVector<Element*, ELEMENT_INLINE_CHILDREN> children;
+    FlatMap<std::string, AttributeValue, ELEMENT_INLINE_ATTRIBUTES> attributes;
+
+    Element* parent = nullptr;
+    bool dirty = true;  // this element or one under it needs render()
+
+    // Mark this element for rendering, and every ancestor for recomposing
+    void invalidate() {
+      dirty = true;
+      for (Element* element = parent; element && !element->dirty; element = element->parent) {
+        element->dirty = true;
+      }
+    }
+
+    // Render only if something in this subtree changed, returns whether it did
+    bool renderIfDirty(RenderParameters params) {
+      if (!dirty) {
+        return false;
+      }
+      dirty = false;  // cleared first, so an animation can invalidate itself again while rendering
+      render(params);
+      return true;
+    }
 
     virtual ~Element() {
       for (auto& i : children) { 
@@ -69,14 +152,70 @@ namespace window {
       } 
     }
 
+    // Type name as passed to createElement
+    virtual const char* elementType() = 0;
+
+    // Size of the most derived object, for the memory report
+    virtual size_t objectSize() = 0;
+
+    // Bytes used by this element alone - the object, spilled containers and long strings
+    size_t memoryUsage() {
+      size_t bytes = objectSize() + children.heapBytes() + attributes.heapBytes();
+      for (auto& attribute : attributes) {
+        bytes += stringHeapBytes(attribute.first) + stringHeapBytes(attribute.second.value);
+      }
+      return bytes;
+    }
+
+    // Print memory use of this element and everything under it, returns the total
+    size_t memoryReport(uint8_t depth = 0) {
+      size_t bytes = memoryUsage();
+      Serial.printf("%*s%s: %u bytes, %u children, %u attributes%s\n", depth * 2, "", elementType(), bytes,
+        children.size(), attributes.size(), (children.heapBytes() || attributes.heapBytes()) ? " (spilled)" : "");
+      size_t total = bytes;
+      for (auto& element : children) {
+        total += element->memoryReport(depth + 1);
+      }
+      if (depth == 0) {
+        Serial.printf("Total: %u bytes\n", total);
+      }
+      return total;
+    }
+
+    static size_t stringHeapBytes(const std::string& string) {
+      const char* data = string.data();
+      if (data >= (const char*)&string && data < (const char*)(&string + 1)) {
+        return 0;  // short string, stored inline
+      }
+      return string.capacity() + 1;
+    }
+
     virtual bool getPixel(uint8_t x, uint8_t y) = 0;
 
     virtual void render(RenderParameters params) = 0;
 
     virtual void childrenUpdate() {}
 
+    // A child is out of children and about to be deleted, drop anything that points at it
+    virtual void childRemoved(Element* child, size_t index) {}
+
+    // A child moved from one position among the children to another
+    virtual void childMoved(size_t from, size_t to) {}
+
     virtual bool handleInput(InputEventType inputEventType) = 0;
 
+    // Called once the driver boards have physically shown a frame
+    virtual void framePresented(PresentParameters params) {
+      for (auto& element : children) {
+        element->framePresented(params);
+      }
+    }
+
+    // Root elements shared with a script task guard the tree with these, and apply its changes at frame boundaries
+    virtual void lockTree() {}
+    virtual void unlockTree() {}
+    virtual void applyCommands() {}
+
   };
 
   class TextElement: public Element {
@@ -105,19 +244,29 @@ namespace window {
       return canvas.getPixel(x, y);
     }
 
+    const char* elementType() {
+      return "text";
+    }
+
+    size_t objectSize() {
+      return sizeof(*this) + (40 + 7) / 8 * 8;  // plus the canvas bitmap
+    }
+
     bool handleInput(InputEventType inputEventType) {
       return false;
     }
 
   };
 
-  class Container: public Element {
+  // Composites its children into a FrameBuffer of Column
+  template <typename Column>
+  class Compositor: public Element {
 
-    FrameBuffer frameBuffer;
+    FrameBuffer<Column> frameBuffer;
 
   public: 
 
-    Container() {
+    Compositor() {
 
     }
 
@@ -125,10 +274,19 @@ namespace window {
       return frameBuffer.getPixel(x, y);
     }
 
-    void render(RenderParameters params) {
+    const char* elementType() {
+      return "container";
+    }
+
+    size_t objectSize() {
+      return sizeof(*this);
+    }
 
+    // Composed from scratch each time, so a child that was removed, moved or shrunk leaves nothing behind
+    void render(RenderParameters params) {
+      frameBuffer.clear();
       for (auto& element : children) {
-        element->render(params);
+        element->renderIfDirty(params);
         uint8_t size_x = 40;
         uint8_t size_y = 8;
         uint8_t pos_x = 0;
@@ -157,11 +315,17 @@ namespace window {
     }
 
     bool handleInput(InputEventType inputEventType) {
+      if (children.empty()) {
+        return false;
+      }
       return children[0]->handleInput(inputEventType);
     }
 
   };
 
+  typedef Compositor<uint8_t> Container;      // 40 x 8, 40 bytes per nested container
+  typedef Compositor<uint64_t> RootContainer;  // 40 x 40 for the activity, whatever the orientation
+
   class InstructionScroller: public Element {
   public:
 
@@ -294,7 +458,7 @@ namespace window {
             instructionComplete();
           } else {
             if (inactiveElement) {
-              inactiveElement->render(params);
+              inactiveElement->renderIfDirty(params);
 
               if (inactiveElement->attributes.count("height") > 0) {
                 inactive_size_y = (uint8_t)std::stoi(inactiveElement->attributes["height"].value);
@@ -317,7 +481,7 @@ namespace window {
         leftoverAnitmationTime = 0;
       }
       if (activeElement) {
-        activeElement->render(params);
+        activeElement->renderIfDirty(params);
 
         if (activeElement->attributes.count("height") > 0) {
           active_size_y = (uint8_t)std::stoi(activeElement->attributes["height"].value);
@@ -335,6 +499,9 @@ namespace window {
         
       }
 
+      if (instructionBuffer.size() > 0) {
+        invalidate();  // still scrolling, render again next frame
+      }
     }
 
     bool handleInput(InputEventType inputEventType) {
@@ -345,9 +512,10 @@ namespace window {
     }
 
     void setElement(Element* element) {
-      instructionBuffer.empty();
+      instructionBuffer.clear();
       activeElement = element;
       offset = 0;
+      invalidate();
     }
 
     virtual void instructionComplete() {}
@@ -356,6 +524,20 @@ namespace window {
 
     virtual void childrenUpdate() {}
 
+    void childRemoved(Element* child, size_t index) {
+      if (activeElement == child) {
+        activeElement = nullptr;
+      }
+      if (inactiveElement == child) {
+        inactiveElement = nullptr;
+      }
+      for (auto& instruction : instructionBuffer) {
+        if (instruction.element == child) {
+          instruction.element = nullptr;
+        }
+      }
+    }
+
   };
 
   class ElementMenu: public InstructionScroller {
@@ -372,8 +554,12 @@ namespace window {
     }
 
     void render(RenderParameters params) {
+      if (children.empty()) {
+        InstructionScroller::render(params);
+        return;
+      }
 
-      int8_t newIndex = constrain(std::stoi(attributes["index"].value), 0, children.size() - 1);
+      int8_t newIndex = constrain(std::stoi(attributes["index"].value), 0, (int)children.size() - 1);
       attributes["index"].value = std::to_string(newIndex);
       while (newIndex != pos) {
         ScrollInstruction scroll;
@@ -408,18 +594,28 @@ namespace window {
     bool getPixel(uint8_t x, uint8_t y) {
       return InstructionScroller::getPixel(x, y);
     }
+
+    const char* elementType() {
+      return "inscroll";
+    }
+
+    size_t objectSize() {
+      return sizeof(*this);
+    }
     
     bool handleInput(InputEventType inputEventType) {
       switch (inputEventType) {
         case UP_SINGLE:
           if (attributes.count("index") > 0) {
             attributes["index"].value = std::to_string(std::stoi(attributes["index"].value) - 1);
+            invalidate();
           }
           return true;
           break;
         case DOWN_SINGLE:
           if (attributes.count("index") > 0) {
             attributes["index"].value = std::to_string(std::stoi(attributes["index"].value) + 1);
+            invalidate();
           }
           return true;
           break;
@@ -429,212 +625,1469 @@ namespace window {
       return false;
     }
 
+    // Appending doesn't move the selection, the first item is shown as soon as it arrives
     void childrenUpdate() {
-      AttributeValue tmp;
-      tmp.value = "0";
-      attributes["index"] = tmp;
-      pos = 0;
-    }
-
-  };
-
-  static duk_ret_t createElement(duk_context* ctx) {
-    Element* newElement = nullptr;
-    Element* parent = (Element*)duk_require_pointer(ctx, 0);
-    const char* type = duk_require_string(ctx, 1);
-
-    if (strcmp(type, "text") == 0) {
-      newElement = new window::TextElement;
-    } else if (strcmp(type, "container") == 0) {
-      newElement = new window::Container;
-    } else if (strcmp(type, "inscroll") == 0) {
-      newElement = new window::ElementMenu;
-    } else {
-      return -1;
+      if (children.size() == 1) {
+        pos = 0;
+        setElement(children[0]);
+      }
     }
 
-    if (newElement) {
-      parent->children.push_back(newElement);
-      parent->childrenUpdate();
-      duk_push_pointer(ctx,(void*)newElement);
-      return 1;
+    // The selection stays on the same item, or the one that takes the removed item's place
+    void childRemoved(Element* child, size_t index) {
+      InstructionScroller::childRemoved(child, index);
+      int selected = std::stoi(attributes["index"].value);
+      if (selected > (int)index || selected >= (int)children.size()) {
+        attributes["index"].value = std::to_string(selected > 0 ? selected - 1 : 0);
+      }
+      if (pos > index) {
+        pos --;
+      } else if (pos == index) {
+        if (pos >= children.size()) {
+          pos = children.empty() ? 0 : children.size() - 1;
+        }
+        setElement(children.empty() ? nullptr : children[pos]);  // scrolls under way lead to the removed item
+      }
     }
-    return -1;
-  }
 
-  static duk_ret_t getAttribute(duk_context* ctx) {
-    Element* element = (Element*)duk_require_pointer(ctx, 0);
-    const char* key = duk_require_string(ctx, 1);
-    
-    if (element->attributes.count(key) > 0) {
-      duk_push_string(ctx, element->attributes[key].value.c_str());
-    } else {
-      duk_push_undefined(ctx);
+    void childMoved(size_t from, size_t to) {
+      int selected = std::stoi(attributes["index"].value);
+      if (selected >= 0) {
+        attributes["index"].value = std::to_string(movedPosition(selected, from, to));
+      }
+      pos = movedPosition(pos, from, to);
     }
-    return 1;
-  }
 
-  static duk_ret_t setAttribute(duk_context* ctx) {
-    Element* element = (Element*)duk_require_pointer(ctx, 0);
-    std::string key = duk_require_string(ctx, 1);
-    AttributeValue setValue;
-    setValue.value = duk_require_string(ctx, 2);
+  private:
 
-    element->attributes[key] = setValue;
+    // Where the item at position was, once the one at from has moved to to
+    static size_t movedPosition(size_t position, size_t from, size_t to) {
+      if (position == from) {
+        return to;
+      }
+      if (from < position && position <= to) {
+        return position - 1;
+      }
+      if (to <= position && position < from) {
+        return position + 1;
+      }
+      return position;
+    }
 
-    return 0;
+  };
 
-  }
+  // A tree change recorded by a script
+  struct Command {
+    enum Type {
+      CREATE_ELEMENT
+    , SET_ATTRIBUTES
+    , RELEASE_ELEMENT   // its script object was collected
+    , REMOVE_ELEMENT
+    , MOVE_ELEMENT
+    };
 
-  static duk_ret_t print(duk_context* ctx) {
-    const char* val = duk_require_string(ctx, 0);
-    Serial.print(val);
-    return 0;
-  }
+    Type type;
+    Element* element;   // element to change, or the parent for CREATE, REMOVE and MOVE_ELEMENT
+    Element* child;     // new, removed or moved element
+    std::vector<std::pair<std::string, std::string>> values;  // SET_ATTRIBUTES, applied with one invalidate
+    uint16_t index = 0; // MOVE_ELEMENT, the child's new position
+
+    void setValue(const char* key, const char* value) {
+      for (auto& keyValue : values) {
+        if (keyValue.first == key) {
+          keyValue.second = value;
+          return;
+        }
+      }
+      values.emplace_back(key, value);
+    }
 
-}
+    const std::string* getValue(const char* key) const {
+      for (auto& keyValue : values) {
+        if (keyValue.first == key) {
+          return &keyValue.second;
+        }
+      }
+      return nullptr;
+    }
+  };
 
-class Activity: public window::Container {
-  duk_context *ctx;
-public:
+  // Tree changes recorded during a script turn, published at its end and applied by the render task in one go
+  class CommandBuffer {
 
-  Activity(std::string name) {
+    std::vector<Command> recording;   // script task only
+    uint8_t batchDepth = 0;
+    size_t batchStart = 0;            // attribute updates in a batch coalesce per element from here
+    std::vector<Command> published;   // guarded by publishLock
+    std::vector<Command> applying;    // render task only
+    SemaphoreHandle_t publishLock;
 
-    Serial.print("Starting activity ");
+  public:
 
+    SemaphoreHandle_t treeLock;
+    Element* root = nullptr;  // never released
 
-    ctx = duk_create_heap_default();
-    if (!ctx) { 
-      ///delete this; TODO: exit in bette way
-      return;
+    CommandBuffer() {
+      publishLock = xSemaphoreCreateMutex();
+      treeLock = xSemaphoreCreateMutex();
     }
 
-    duk_push_global_object(ctx);
+    ~CommandBuffer() {
+      for (auto* commands : {&recording, &published}) {
+        for (auto& command : *commands) {
+          if (command.type == Command::CREATE_ELEMENT) {
+            delete command.child;  // never made it into the tree
+          }
+        }
+      }
+      vSemaphoreDelete(publishLock);
+      vSemaphoreDelete(treeLock);
+    }
 
-    duk_push_pointer(ctx, (void*)this);
-    duk_put_prop_string(ctx, 0, "objectPointer");
+    void createElement(Element* parent, Element* child) {
+      recording.push_back({Command::CREATE_ELEMENT, parent, child, {}});
+      batchStart = recording.size();  // attribute updates don't move across tree changes
+    }
 
-    duk_push_c_function(ctx, window::createElement, 2);
-    duk_put_prop_string(ctx, 0, "createElement");
+    // Consecutive updates to one element, or any in a batch, share one command
+    void setAttribute(Element* element, const char* key, const char* value) {
+      size_t first = batchDepth ? batchStart : (recording.empty() ? 0 : recording.size() - 1);
+      for (size_t i = recording.size(); i > first; i --) {
+        Command& command = recording[i - 1];
+        if (command.type == Command::SET_ATTRIBUTES && command.element == element) {
+          command.setValue(key, value);
+          return;
+        }
+      }
+      recording.push_back({Command::SET_ATTRIBUTES, element, nullptr, {}});
+      recording.back().setValue(key, value);
+    }
 
-    duk_push_c_function(ctx, window::getAttribute, 2);
-    duk_put_prop_string(ctx, 0, "getAttribute");
+    void releaseElement(Element* element) {
+      recording.push_back({Command::RELEASE_ELEMENT, element, nullptr, {}});
+      batchStart = recording.size();
+    }
 
-    duk_push_c_function(ctx, window::setAttribute, 3);
-    duk_put_prop_string(ctx, 0, "setAttribute");
+    // Deletes child and everything under it once applied, the script must hold no more objects for them
+    void removeElement(Element* parent, Element* child) {
+      recording.push_back({Command::REMOVE_ELEMENT, parent, child, {}});
+      batchStart = recording.size();
+    }
 
-    duk_push_c_function(ctx, window::print, 1);
-    duk_put_prop_string(ctx, 0, "print");
-    Serial.print("Loading JS");
+    void moveElement(Element* parent, Element* child, uint16_t index) {
+      recording.push_back({Command::MOVE_ELEMENT, parent, child, {}, index});
+      batchStart = recording.size();
+    }
 
-    Serial.print("Activity started");
+    // Nothing is published until the outermost batch ends
+    void beginBatch() {
+      if (batchDepth ++ == 0) {
+        batchStart = recording.size();
+      }
+    }
 
+    void endBatch() {
+      if (batchDepth) {
+        batchDepth --;
+      }
+    }
 
-  }
-};
+    // Latest value the script set for an attribute that the tree hasn't seen yet
+    bool pendingAttribute(Element* element, const char* key, std::string& value) {
+      for (auto command = recording.rbegin(); command != recording.rend(); command ++) {
+        const std::string* pending;
+        if (command->type == Command::SET_ATTRIBUTES && command->element == element && (pending = command->getValue(key))) {
+          value = *pending;
+          return true;
+        }
+      }
+      bool found = false;
+      xSemaphoreTake(publishLock, portMAX_DELAY);
+      for (auto command = published.rbegin(); command != published.rend(); command ++) {
+        const std::string* pending;
+        if (command->type == Command::SET_ATTRIBUTES && command->element == element && (pending = command->getValue(key))) {
+          value = *pending;
+          found = true;
+          break;
+        }
+      }
+      xSemaphoreGive(publishLock);
+      return found;
+    }
 
-/*
-class Scroller: public WindowElement {
+    // End of a script turn
+    void publish() {
+      if (recording.empty() || batchDepth) {
+        return;
+      }
+      xSemaphoreTake(publishLock, portMAX_DELAY);
+      for (auto& command : recording) {
+        published.push_back(std::move(command));
+      }
+      xSemaphoreGive(publishLock);
+      recording.clear();
+      batchStart = 0;
+    }
 
-  uint16_t stepRemaining = 0;
-  
-public:
+    // Where child was among parent's children, or -1 if it wasn't one
+    static int removeChild(Element* parent, Element* child) {
+      for (auto item = parent->children.begin(); item != parent->children.end(); item ++) {
+        if (*item == child) {
+          int index = item - parent->children.begin();
+          parent->children.erase(item);
+          return index;
+        }
+      }
+      return -1;
+    }
 
-  uint8_t scrollerViewSize;
+    // Render task, with treeLock held
+    void apply() {
+      xSemaphoreTake(publishLock, portMAX_DELAY);
+      applying.swap(published);
+      xSemaphoreGive(publishLock);
+
+      for (auto& command : applying) {
+        switch (command.type) {
+          case Command::CREATE_ELEMENT:
+            command.element->children.push_back(command.child);
+            command.child->parent = command.element;
+            command.element->childrenUpdate();
+            command.element->invalidate();
+            break;
+          case Command::SET_ATTRIBUTES:
+            for (auto& keyValue : command.values) {
+              AttributeValue& attribute = command.element->attributes[keyValue.first];
+              attribute.value = std::move(keyValue.second);
+              attribute.update = true;
+            }
+            command.element->invalidate();
+            break;
+          case Command::RELEASE_ELEMENT:
+            if (!command.element->parent && command.element != root) {
+              delete command.element;  // the tree owns attached elements, the script object detached ones
+            }
+            break;
+          case Command::REMOVE_ELEMENT: {
+            int from = removeChild(command.element, command.child);
+            if (from >= 0) {
+              command.element->childRemoved(command.child, from);
+            }
+            command.element->invalidate();
+            delete command.child;
+            break;
+          }
+          case Command::MOVE_ELEMENT: {
+            int from = removeChild(command.element, command.child);
+            if (from >= 0) {
+              auto& children = command.element->children;
+              size_t index = command.index < children.size() ? command.index : children.size();
+              children.insert(children.begin() + index, std::move(command.child));
+              command.element->childMoved(from, index);
+              command.element->invalidate();
+            }
+            break;
+          }
+        }
+      }
+      applying.clear();
+    }
+  };
 
-  uint16_t scrollerSize;
+  static CommandBuffer* commandBuffer(duk_context* ctx) {
+    duk_push_global_stash(ctx);
+    duk_get_prop_string(ctx, -1, "commandBuffer");
+    CommandBuffer* commands = (CommandBuffer*)duk_get_pointer(ctx, -1);
+    duk_pop_2(ctx);
+    return commands;
+  }
 
-  int16_t position = 0;
-  int16_t targetPosition = 0;
+  // Native side of setTimeout and setInterval - deadlines on the shared timer
+  // wheel, which lists the ids as they come due. The script task takes the
+  // whole list at the next frame boundary and runs those callbacks together.
+  class ScriptTimers {
+
+    struct Entry {
+      WheelTimer timer;
+      ScriptTimers* owner;
+      uint32_t id;
+      bool repeat;
+      bool queued = false;  // an interval that comes round again before it ran still runs once
+
+      Entry(ScriptTimers* owner, uint32_t id, bool repeat)
+      : timer(expired, this), owner(owner), id(id), repeat(repeat)
+      {}
+    };
 
-  bool vertical;
+    FlatMap<uint32_t, Entry*, 4> entries;  // script task only
+    std::vector<uint32_t> due;             // guarded by dueLock
+    SemaphoreHandle_t dueLock;
+    uint32_t lastId = 0;
+
+    // On the timer task
+    static void expired(void* arg) {
+      Entry* entry = (Entry*)arg;
+      ScriptTimers* owner = entry->owner;
+      xSemaphoreTake(owner->dueLock, portMAX_DELAY);
+      if (!entry->queued) {
+        entry->queued = true;
+        owner->due.push_back(entry->id);
+        owner->pending = true;
+      }
+      xSemaphoreGive(owner->dueLock);
+    }
 
-  struct segment {
-    uint8_t start;
-    uint8_t size;
-    WindowElement* source;
-  };
+  public:
 
-  std::vector<segment> segments;
+    volatile bool pending = false;  // ids are due, so the next frame wakes the script task
 
-  uint16_t getScrollerSize() {
-    uint16_t size = 0;
-    for (auto& segment : segments) {
-      size += segment.size;
+    ScriptTimers() {
+      dueLock = xSemaphoreCreateMutex();
     }
-    return size;
-  }
 
-  void limitPosition() {
-    while (position + scrollerViewSize  > scrollerSize) {
-      position -= scrollerSize;
-    } 
-    return;
-    while (position - scrollerViewSize  < -1*scrollerSize) {
-      position += scrollerSize;
+    ~ScriptTimers() {
+      for (auto& entry : entries) {
+        timers.cancel(entry.second->timer);
+        delete entry.second;
+      }
+      vSemaphoreDelete(dueLock);
     }
-    return;
-  }
 
-  void buildSegments(int16_t position) {
-    int16_t elementLowerPosition = -1*scrollerSize;
-    uint8_t elementIndex = 0;
-    WindowElement* currentElement;
+    uint32_t start(uint32_t delayMs, bool repeat) {
+      uint32_t id = ++ lastId;
+      Entry* entry = new Entry(this, id, repeat);
+      entries[id] = entry;
+      timers.start(entry->timer, delayMs, repeat ? (delayMs ? delayMs : 1) : 0);
+      return id;
+    }
 
-    scrollerSize = getScrollerSize();
-    limitPosition();
+    bool clear(uint32_t id) {
+      auto item = entries.find(id);
+      if (item == entries.end()) {
+        return false;
+      }
+      Entry* entry = item->second;
+      timers.cancel(entry->timer);
+      entries.erase(id);
+      delete entry;
+      return true;
+    }
 
-    if (vertical) {
-      elementLowerPosition += components[0]->size_y;
-    } else {
-      elementLowerPosition += components[0]->size_x;
+    // Ids that came due since the last call, in the order they did
+    void takeDue(std::vector<uint32_t>& batch) {
+      batch.clear();
+      xSemaphoreTake(dueLock, portMAX_DELAY);
+      batch.swap(due);
+      pending = false;
+      for (uint32_t id : batch) {
+        auto item = entries.find(id);
+        if (item != entries.end()) {
+          item->second->queued = false;
+        }
+      }
+      xSemaphoreGive(dueLock);
     }
 
-    while (elementLowerPosition < position) {
-      elementIndex ++;
-      elementIndex = elementIndex % components.size();
-      currentElement = components[elementIndex];
-      if (vertical) {
-        elementLowerPosition += currentElement->size_y;
-      } else {
-        elementLowerPosition += currentElement->size_x;
+    // Whether a due id still has a callback to run, a timeout is forgotten here
+    bool fire(uint32_t id, bool& repeat) {
+      auto item = entries.find(id);
+      if (item == entries.end()) {
+        return false;  // cleared after it came due
+      }
+      repeat = item->second->repeat;
+      if (!repeat) {
+        clear(id);
       }
+      return true;
     }
+  };
 
-    segments.clear();
+  static ScriptTimers* scriptTimers(duk_context* ctx) {
+    duk_push_global_stash(ctx);
+    duk_get_prop_string(ctx, -1, "scriptTimers");
+    ScriptTimers* scriptTimers = (ScriptTimers*)duk_get_pointer(ctx, -1);
+    duk_pop_2(ctx);
+    return scriptTimers;
+  }
 
-    while (elementLowerPosition <= position + scrollerViewSize) {
-      segment nextSegment;
-      currentElement = components[elementIndex];
-      nextSegment.source = currentElement;
-      if (vertical) {
-        nextSegment.start = elementLowerPosition - currentElement->size_y;
-        nextSegment.size = currentElement->size_y;
-      } else {
-        nextSegment.start = elementLowerPosition - currentElement->size_x;
-        nextSegment.size = currentElement->size_x;
-      }
-      segments.push_back(nextSegment); // right vector order?
+  // Script objects for elements share one native prototype, and hold the element in a hidden property
 
-      elementIndex ++;
-      elementIndex = elementIndex % components.size();
-      currentElement = components[elementIndex];
+  // Attributes with their own accessor on the prototype, indexed by the accessor's magic
+  static const char* const knownAttributes[] = {"value", "x", "y", "width", "height", "index"};
 
-      if (vertical) {
-        elementLowerPosition += currentElement->size_y;
-      } else {
-        elementLowerPosition += currentElement->size_x;
-      }
+  static Element* elementOf(duk_context* ctx, duk_idx_t index) {
+    duk_get_prop_literal(ctx, index, DUK_HIDDEN_SYMBOL("element"));
+    Element* element = (Element*)duk_get_pointer(ctx, -1);
+    duk_pop(ctx);
+    if (!element) {
+      (void)duk_type_error(ctx, "not an element");
     }
+    return element;
   }
 
-  void updateScroller(int16_t position = 0) {
-    buildSegments(position);
+  static Element* thisElement(duk_context* ctx) {
+    duk_push_this(ctx);
+    Element* element = elementOf(ctx, -1);
+    duk_pop(ctx);
+    return element;
   }
 
-  Scroller(bool vertical = true)
-  : vertical(vertical)
-  {
+  static void pushAttribute(duk_context* ctx, Element* element, const char* key) {
+    CommandBuffer* commands = commandBuffer(ctx);
+
+    std::string value;
+    if (commands->pendingAttribute(element, key, value)) {
+      duk_push_string(ctx, value.c_str());
+      return;
+    }
+
+    xSemaphoreTake(commands->treeLock, portMAX_DELAY);
+    auto attribute = element->attributes.find(key);
+    if (attribute != element->attributes.end()) {
+      duk_push_string(ctx, attribute->second.value.c_str());
+    } else {
+      duk_push_undefined(ctx);
+    }
+    xSemaphoreGive(commands->treeLock);
+  }
+
+  static duk_ret_t knownAttributeGet(duk_context* ctx) {
+    pushAttribute(ctx, thisElement(ctx), knownAttributes[duk_get_current_magic(ctx)]);
+    return 1;
+  }
+
+  static duk_ret_t knownAttributeSet(duk_context* ctx) {
+    commandBuffer(ctx)->setAttribute(thisElement(ctx), knownAttributes[duk_get_current_magic(ctx)], duk_to_string(ctx, 0));
+    return 0;
+  }
+
+  static duk_ret_t getAttribute(duk_context* ctx) {
+    pushAttribute(ctx, thisElement(ctx), duk_require_string(ctx, 0));
+    return 1;
+  }
+
+  static duk_ret_t setAttribute(duk_context* ctx) {
+    Element* element = thisElement(ctx);
+    commandBuffer(ctx)->setAttribute(element, duk_require_string(ctx, 0), duk_to_string(ctx, 1));
+    return 0;
+  }
+
+  static void setAttributesFrom(duk_context* ctx, Element* element, duk_idx_t values) {
+    CommandBuffer* commands = commandBuffer(ctx);
+    duk_enum(ctx, values, DUK_ENUM_OWN_PROPERTIES_ONLY);
+    while (duk_next(ctx, -1, 1)) {
+      commands->setAttribute(element, duk_to_string(ctx, -2), duk_to_string(ctx, -1));
+      duk_pop_2(ctx);
+    }
+    duk_pop(ctx);
+  }
+
+  // element.setAttributes({name: value, ...})
+  static duk_ret_t setAttributesMethod(duk_context* ctx) {
+    duk_require_object(ctx, 0);
+    setAttributesFrom(ctx, thisElement(ctx), 0);
+    return 0;
+  }
+
+  // setAttributes(element, {name: value, ...})
+  static duk_ret_t setAttributes(duk_context* ctx) {
+    duk_require_object(ctx, 1);
+    setAttributesFrom(ctx, elementOf(ctx, 0), 1);
+    return 0;
+  }
+
+  // batch(fn) - everything fn changes reaches the display in the same frame, one command per element
+  static duk_ret_t batch(duk_context* ctx) {
+    duk_require_function(ctx, 0);
+    CommandBuffer* commands = commandBuffer(ctx);
+    commands->beginBatch();
+    duk_dup(ctx, 0);
+    duk_int_t result = duk_pcall(ctx, 0);
+    commands->endBatch();
+    if (result != DUK_EXEC_SUCCESS) {
+      (void)duk_throw(ctx);
+    }
+    return 1;
+  }
+
+  // Kept so scripts written against the old attribute proxy still work
+  static duk_ret_t attributesGet(duk_context* ctx) {
+    duk_push_this(ctx);
+    return 1;
+  }
+
+  static duk_ret_t childrenGet(duk_context* ctx) {
+    duk_push_this(ctx);
+    duk_get_prop_literal(ctx, -1, DUK_HIDDEN_SYMBOL("children"));
+    return 1;
+  }
+
+  static void pushElementObject(duk_context* ctx, Element* element) {
+    duk_push_object(ctx);
+    duk_push_pointer(ctx, (void*)element);
+    duk_put_prop_literal(ctx, -2, DUK_HIDDEN_SYMBOL("element"));
+    duk_push_array(ctx);
+    duk_put_prop_literal(ctx, -2, DUK_HIDDEN_SYMBOL("children"));
+    duk_push_global_stash(ctx);
+    duk_get_prop_literal(ctx, -1, "elementPrototype");
+    duk_set_prototype(ctx, -3);
+    duk_pop(ctx);
+  }
+
+  // Create a child of the element object at parentIndex, push its object and add it to the parent's children
+  static Element* pushNewElement(duk_context* ctx, duk_idx_t parentIndex, const char* type) {
+    parentIndex = duk_require_normalize_index(ctx, parentIndex);
+    Element* parent = elementOf(ctx, parentIndex);
+    Element* newElement;
+    if (strcmp(type, "text") == 0) {
+      newElement = new window::TextElement;
+    } else if (strcmp(type, "container") == 0) {
+      newElement = new window::Container;
+    } else if (strcmp(type, "inscroll") == 0) {
+      newElement = new window::ElementMenu;
+    } else {
+      (void)duk_range_error(ctx, "unknown element type %s", type);
+      return nullptr;
+    }
+    commandBuffer(ctx)->createElement(parent, newElement);  // joins the tree at the next frame
+
+    pushElementObject(ctx, newElement);
+    duk_get_prop_literal(ctx, parentIndex, DUK_HIDDEN_SYMBOL("children"));
+    duk_dup(ctx, -2);
+    duk_put_prop_index(ctx, -2, duk_get_length(ctx, -2));
+    duk_pop(ctx);
+    return newElement;
+  }
+
+  // createElement(parent, type)
+  static duk_ret_t createElement(duk_context* ctx) {
+    pushNewElement(ctx, 0, duk_require_string(ctx, 1));
+    return 1;
+  }
+
+  // Matches the children to descriptions - {type, key, attributes: {name: value}, children: [...]} - with
+  // reconcile() from the prelude, which diffs them against the last layout
+  static duk_ret_t childrenSet(duk_context* ctx) {
+    if (!duk_get_global_string(ctx, "reconcile") || !duk_is_callable(ctx, -1)) {
+      return duk_type_error(ctx, "no reconcile() in the prelude");
+    }
+    duk_push_this(ctx);
+    duk_dup(ctx, 0);
+    duk_call(ctx, 2);
+    return 0;
+  }
+
+  // Position of the object at child in the array at array, -1 if it isn't there
+  static duk_int_t indexIn(duk_context* ctx, duk_idx_t array, duk_idx_t child) {
+    array = duk_require_normalize_index(ctx, array);
+    child = duk_require_normalize_index(ctx, child);
+    duk_uarridx_t count = duk_get_length(ctx, array);
+    for (duk_uarridx_t i = 0; i < count; i ++) {
+      duk_get_prop_index(ctx, array, i);
+      bool same = duk_strict_equals(ctx, -1, child);
+      duk_pop(ctx);
+      if (same) {
+        return i;
+      }
+    }
+    return -1;
+  }
+
+  static void removeFromArray(duk_context* ctx, duk_idx_t array, duk_uarridx_t index) {
+    array = duk_require_normalize_index(ctx, array);
+    duk_uarridx_t count = duk_get_length(ctx, array);
+    for (duk_uarridx_t i = index; i + 1 < count; i ++) {
+      duk_get_prop_index(ctx, array, i + 1);
+      duk_put_prop_index(ctx, array, i);
+    }
+    duk_set_length(ctx, array, count - 1);
+  }
+
+  static void insertIntoArray(duk_context* ctx, duk_idx_t array, duk_uarridx_t index, duk_idx_t value) {
+    array = duk_require_normalize_index(ctx, array);
+    value = duk_require_normalize_index(ctx, value);
+    for (duk_uarridx_t i = duk_get_length(ctx, array); i > index; i --) {
+      duk_get_prop_index(ctx, array, i - 1);
+      duk_put_prop_index(ctx, array, i);
+    }
+    duk_dup(ctx, value);
+    duk_put_prop_index(ctx, array, index);
+  }
+
+  // The object at index and every object under it stop referring to their elements, which are about to go
+  static void detachElementObject(duk_context* ctx, duk_idx_t index) {
+    index = duk_require_normalize_index(ctx, index);
+    duk_get_prop_literal(ctx, index, DUK_HIDDEN_SYMBOL("children"));
+    duk_uarridx_t count = duk_get_length(ctx, -1);
+    for (duk_uarridx_t i = 0; i < count; i ++) {
+      duk_get_prop_index(ctx, -1, i);
+      detachElementObject(ctx, -1);
+      duk_pop(ctx);
+    }
+    duk_pop(ctx);
+    duk_push_pointer(ctx, nullptr);  // its finalizer has nothing to release
+    duk_put_prop_literal(ctx, index, DUK_HIDDEN_SYMBOL("element"));
+    duk_push_array(ctx);
+    duk_put_prop_literal(ctx, index, DUK_HIDDEN_SYMBOL("children"));
+  }
+
+  // element.removeChild(child) - child and everything under it leave the tree for good at the next frame
+  static duk_ret_t removeChild(duk_context* ctx) {
+    Element* parent = thisElement(ctx);
+    Element* child = elementOf(ctx, 0);
+    duk_push_this(ctx);
+    duk_get_prop_literal(ctx, -1, DUK_HIDDEN_SYMBOL("children"));
+    duk_int_t index = indexIn(ctx, -1, 0);
+    if (index < 0) {
+      return duk_range_error(ctx, "not a child of this element");
+    }
+    removeFromArray(ctx, -1, index);
+    commandBuffer(ctx)->removeElement(parent, child);
+    detachElementObject(ctx, 0);
+    return 0;
+  }
+
+  // element.moveChild(child, index) - child moves to position index among the element's children
+  static duk_ret_t moveChild(duk_context* ctx) {
+    Element* parent = thisElement(ctx);
+    Element* child = elementOf(ctx, 0);
+    duk_uint_t index = duk_require_uint(ctx, 1);
+    duk_push_this(ctx);
+    duk_get_prop_literal(ctx, -1, DUK_HIDDEN_SYMBOL("children"));
+    duk_int_t from = indexIn(ctx, -1, 0);
+    if (from < 0) {
+      return duk_range_error(ctx, "not a child of this element");
+    }
+    duk_uarridx_t count = duk_get_length(ctx, -1);
+    if (index >= count) {
+      index = count - 1;
+    }
+    if (index == (duk_uint_t)from) {
+      return 0;
+    }
+    removeFromArray(ctx, -1, from);
+    insertIntoArray(ctx, -1, index, 0);
+    commandBuffer(ctx)->moveElement(parent, child, index);
+    return 0;
+  }
+
+  // Runs on the script task when an element object is collected
+  static duk_ret_t elementFinalizer(duk_context* ctx) {
+    duk_get_prop_literal(ctx, 0, DUK_HIDDEN_SYMBOL("element"));
+    Element* element = (Element*)duk_get_pointer(ctx, -1);
+    if (element) {
+      commandBuffer(ctx)->releaseElement(element);
+    }
+    return 0;
+  }
+
+  static duk_ret_t memoryReport(duk_context* ctx) {
+    Element* element = thisElement(ctx);
+    CommandBuffer* commands = commandBuffer(ctx);
+    xSemaphoreTake(commands->treeLock, portMAX_DELAY);
+    size_t bytes = element->memoryReport();
+    xSemaphoreGive(commands->treeLock);
+    duk_push_uint(ctx, bytes);
+    return 1;
+  }
+
+  static void defineAccessor(duk_context* ctx, const char* name, duk_c_function get, duk_c_function set, duk_int_t magic = 0) {
+    duk_push_string(ctx, name);
+    duk_push_c_function(ctx, get, 0);
+    duk_set_magic(ctx, -1, magic);
+    duk_uint_t flags = DUK_DEFPROP_HAVE_GETTER | DUK_DEFPROP_SET_ENUMERABLE;
+    if (set) {
+      duk_push_c_function(ctx, set, 1);
+      duk_set_magic(ctx, -1, magic);
+      flags |= DUK_DEFPROP_HAVE_SETTER;
+    }
+    duk_def_prop(ctx, set ? -4 : -3, flags);
+  }
+
+  // Build the element prototype into the global stash
+  static void registerElementPrototype(duk_context* ctx) {
+    duk_push_global_stash(ctx);
+    duk_push_object(ctx);
+
+    for (duk_int_t i = 0; i < (duk_int_t)(sizeof(knownAttributes) / sizeof(knownAttributes[0])); i ++) {
+      defineAccessor(ctx, knownAttributes[i], knownAttributeGet, knownAttributeSet, i);
+    }
+    defineAccessor(ctx, "attributes", attributesGet, nullptr);
+    defineAccessor(ctx, "children", childrenGet, childrenSet);
+
+    const duk_function_list_entry methods[] = {
+      {"getAttribute", getAttribute, 1},
+      {"setAttribute", setAttribute, 2},
+      {"setAttributes", setAttributesMethod, 1},
+      {"removeChild", removeChild, 1},
+      {"moveChild", moveChild, 2},
+      {"memoryReport", memoryReport, 0},
+      {nullptr, nullptr, 0}
+    };
+    duk_put_function_list(ctx, -1, methods);
+
+    duk_push_c_function(ctx, elementFinalizer, 2);
+    duk_set_finalizer(ctx, -2);
+
+    duk_put_prop_literal(ctx, -2, "elementPrototype");
+    duk_pop(ctx);
+  }
+
+  // requestAnimationFrame(callback) - callback(elapsed ms) runs once, after the next frame is shown
+  static duk_ret_t requestAnimationFrame(duk_context* ctx) {
+    duk_require_function(ctx, 0);
+    duk_push_global_stash(ctx);
+    duk_get_prop_string(ctx, -1, "animationFrameId");
+    duk_uint_t id = duk_get_uint(ctx, -1) + 1;
+    duk_pop(ctx);
+    duk_push_uint(ctx, id);
+    duk_put_prop_string(ctx, -2, "animationFrameId");
+
+    duk_get_prop_string(ctx, -1, "animationFrames");
+    duk_dup(ctx, 0);
+    duk_put_prop_index(ctx, -2, id);
+    duk_push_uint(ctx, id);
+    return 1;
+  }
+
+  // cancelAnimationFrame(id)
+  static duk_ret_t cancelAnimationFrame(duk_context* ctx) {
+    duk_uint_t id = duk_require_uint(ctx, 0);
+    duk_push_global_stash(ctx);
+    duk_get_prop_string(ctx, -1, "animationFrames");
+    duk_del_prop_index(ctx, -1, id);
+    return 0;
+  }
+
+  static duk_ret_t startTimer(duk_context* ctx, bool repeat) {
+    duk_require_function(ctx, 0);
+    duk_int_t delay = duk_get_int_default(ctx, 1, 0);
+    uint32_t id = scriptTimers(ctx)->start(delay > 0 ? delay : 0, repeat);
+    duk_push_global_stash(ctx);
+    duk_get_prop_string(ctx, -1, "timers");
+    duk_dup(ctx, 0);
+    duk_put_prop_index(ctx, -2, id);
+    duk_push_uint(ctx, id);
+    return 1;
+  }
+
+  // setTimeout(callback, ms) - callback() runs once, at the first frame after ms have passed
+  static duk_ret_t setTimeout(duk_context* ctx) {
+    return startTimer(ctx, false);
+  }
+
+  // setInterval(callback, ms) - callback() runs every ms, at most once a frame
+  static duk_ret_t setInterval(duk_context* ctx) {
+    return startTimer(ctx, true);
+  }
+
+  // clearTimeout(id), also clearInterval - ids that aren't running are ignored
+  static duk_ret_t clearTimeout(duk_context* ctx) {
+    if (!duk_is_number(ctx, 0)) {
+      return 0;
+    }
+    duk_uint_t id = duk_get_uint(ctx, 0);
+    if (scriptTimers(ctx)->clear(id)) {
+      duk_push_global_stash(ctx);
+      duk_get_prop_string(ctx, -1, "timers");
+      duk_del_prop_index(ctx, -1, id);
+    }
+    return 0;
+  }
+
+  static duk_ret_t print(duk_context* ctx) {
+    const char* val = duk_require_string(ctx, 0);
+    Serial.print(val);
+    return 0;
+  }
+
+}
+
+// Runs scripts from the data partition in one Duktape heap, from the bytecode cache when the source hasn't changed
+class ScriptLoader {
+
+  // Stored ahead of the duk_dump_function() output
+  struct CacheHeader {
+    uint32_t magic;       // per Duktape profile, the lowmem build's bytecode differs
+    uint32_t version;     // DUK_VERSION, bytecode isn't portable between releases
+    uint32_t sourceHash;  // FNV-1a of the script source
+    uint32_t length;
+  };
+
+  duk_context* ctx;
+
+public:
+
+  uint8_t compiled = 0;
+  uint8_t cached = 0;
+
+  ScriptLoader(duk_context* ctx)
+  : ctx(ctx)
+  {}
+
+  static bool mount() {
+    static bool mounted = false;
+    if (!mounted) {
+      mounted = LittleFS.begin(true);
+      if (!mounted) {
+        Serial.println("LittleFS mount failed");
+      } else if (!LittleFS.exists(SCRIPT_CACHE_DIR)) {
+        LittleFS.mkdir(SCRIPT_CACHE_DIR);
+      }
+    }
+    return mounted;
+  }
+
+  // The prelude defines the element bindings every activity script builds on
+  bool loadPrelude() {
+    duk_push_global_stash(ctx);
+    bool loaded = duk_get_prop_string(ctx, -1, "preludeLoaded") && duk_to_boolean(ctx, -1);
+    duk_pop(ctx);
+    if (!loaded && run(SCRIPT_PRELUDE)) {
+      duk_push_true(ctx);
+      duk_put_prop_string(ctx, -2, "preludeLoaded");
+      loaded = true;
+    }
+    duk_pop(ctx);
+    return loaded;
+  }
+
+  // Run /<script>.js, reporting where the time went
+  bool run(const char* script) {
+    char path[48];
+    char cachePath[48];
+    snprintf(path, sizeof(path), "/%s.js", script);
+    snprintf(cachePath, sizeof(cachePath), SCRIPT_CACHE_DIR "/%s.bc", script);
+
+    if (!mount()) {
+      return false;
+    }
+    uint32_t began = micros();
+    File source = LittleFS.open(path, "r");
+    if (!source) {
+      Serial.printf("No script %s\n", path);
+      return false;
+    }
+    size_t length = source.size();
+
+    // With a cache entry to check against, the source only streams through a small buffer for hashing
+    bool fromCache = false;
+    File cache = LittleFS.open(cachePath, "r");
+    CacheHeader header;
+    if (cache && readHeader(cache, header)) {
+      uint8_t chunk[SCRIPT_CHUNK];
+      uint32_t sourceHash = FNV_OFFSET;
+      size_t read;
+      while ((read = source.read(chunk, sizeof(chunk))) > 0) {
+        sourceHash = fnv1a(chunk, read, sourceHash);
+      }
+      fromCache = header.sourceHash == sourceHash && loadBytecode(cache, header);
+    }
+    if (cache) {
+      cache.close();
+    }
+    uint32_t loaded = micros();
+
+    uint32_t sourceHash = FNV_OFFSET;
+    if (!fromCache) {
+      // Read straight into a Duktape buffer in chunks, so the source is never held twice
+      source.seek(0);
+      uint8_t* buffer = (uint8_t*)duk_push_fixed_buffer(ctx, length);
+      size_t offset = 0;
+      while (offset < length) {
+        size_t read = source.read(buffer + offset, length - offset < SCRIPT_CHUNK ? length - offset : SCRIPT_CHUNK);
+        if (read == 0) {
+          break;
+        }
+        sourceHash = fnv1a(buffer + offset, read, sourceHash);
+        offset += read;
+      }
+      loaded = micros();
+
+      duk_push_string(ctx, path);
+      if (duk_pcompile_lstring_filename(ctx, 0, (const char*)buffer, offset) != 0) {
+        Serial.println(duk_safe_to_string(ctx, -1));
+        duk_pop_2(ctx);
+        source.close();
+        return false;
+      }
+      duk_remove(ctx, -2);  // source, before the dump needs memory of its own
+      storeBytecode(cachePath, sourceHash);
+    }
+    source.close();
+    uint32_t compiledAt = micros();
+
+    bool success = duk_pcall(ctx, 0) == DUK_EXEC_SUCCESS;
+    if (!success) {
+      Serial.println(duk_safe_to_string(ctx, -1));
+    }
+    duk_pop(ctx);
+
+    if (fromCache) {
+      cached ++;
+      Serial.printf("Script %s: %u bytes, hash and bytecode load %lu us, run %lu us\n", path, length,
+        loaded - began, micros() - compiledAt);
+    } else {
+      compiled ++;
+      Serial.printf("Script %s: %u bytes, read %lu us, compile and cache %lu us, run %lu us\n", path, length,
+        loaded - began, compiledAt - loaded, micros() - compiledAt);
+    }
+    return success;
+  }
+
+private:
+
+  static const uint32_t FNV_OFFSET = 2166136261u;
+
+  static uint32_t fnv1a(const uint8_t* data, size_t length, uint32_t hash) {
+    for (size_t i = 0; i < length; i ++) {
+      hash = (hash ^ data[i]) * 16777619u;
+    }
+    return hash;
+  }
+
+  static duk_ret_t loadFunction(duk_context* ctx, void* udata) {
+    duk_load_function(ctx);
+    return 1;
+  }
+
+  bool readHeader(File& cache, CacheHeader& header) {
+    return cache.read((uint8_t*)&header, sizeof(header)) == sizeof(header)
+      && header.magic == SCRIPT_CACHE_MAGIC && header.version == DUK_VERSION
+      && header.length == cache.size() - sizeof(header);
+  }
+
+  // Push the cached function, or nothing if the blob won't load
+  bool loadBytecode(File& cache, const CacheHeader& header) {
+    void* bytecode = duk_push_fixed_buffer(ctx, header.length);
+    if (cache.read((uint8_t*)bytecode, header.length) != header.length
+     || duk_safe_call(ctx, loadFunction, nullptr, 1, 1) != DUK_EXEC_SUCCESS) {
+      duk_pop(ctx);
+      return false;
+    }
+    return true;
+  }
+
+  // Dump the compiled function on top of the stack into the cache
+  void storeBytecode(const char* cachePath, uint32_t sourceHash) {
+    duk_dup(ctx, -1);
+    duk_dump_function(ctx);
+    duk_size_t length;
+    void* bytecode = duk_get_buffer(ctx, -1, &length);
+
+    File cache = LittleFS.open(cachePath, "w");
+    if (cache) {
+      CacheHeader header = {SCRIPT_CACHE_MAGIC, DUK_VERSION, sourceHash, (uint32_t)length};
+      cache.write((const uint8_t*)&header, sizeof(header));
+      cache.write((const uint8_t*)bytecode, length);
+      cache.close();
+    }
+    duk_pop(ctx);
+  }
+};
+
+// Duktape heap udata - the allocator pool, and the deadline of the callback running in the heap
+struct ActivityHeap: public HeapPool {
+  volatile uint32_t deadline = 0;  // micros(), 0 while no budget applies
+  bool timedOut = false;
+
+  ActivityHeap(size_t size, bool psram)
+  : HeapPool(size, psram)
+  {}
+};
+
+// DUK_USE_EXEC_TIMEOUT_CHECK, polled by the bytecode executor
+extern "C" duk_bool_t activityExecTimeout(void* udata) {
+  ActivityHeap* heap = static_cast<ActivityHeap*>((HeapPool*)udata);
+  if (heap && heap->deadline && (int32_t)(micros() - heap->deadline) >= 0) {
+    heap->timedOut = true;
+    return 1;
+  }
+  return 0;
+}
+
+#ifdef FLIPDOT_DUK_LOWMEM
+#if ACTIVITY_HEAP_SIZE > 8 * DUK_USE_ROM_PTRCOMP_FIRST
+#error Activity heaps must stay within the range of 16 bit compressed pointers
+#endif
+
+#if defined(DUK_USE_ROM_OBJECTS)
+extern "C" const void* const duk_rom_compressed_pointers[];
+#endif
+
+// DUK_USE_HEAPPTR_ENC16 - 8 byte units from the start of the pool, ROM objects above DUK_USE_ROM_PTRCOMP_FIRST
+extern "C" duk_uint16_t activityHeapEnc16(void* udata, void* pointer) {
+  if (!pointer) {
+    return 0;
+  }
+  const uint8_t* base = ((HeapPool*)udata)->base();
+  if ((const uint8_t*)pointer >= base && (const uint8_t*)pointer < base + ACTIVITY_HEAP_SIZE) {
+    return (duk_uint16_t)(((const uint8_t*)pointer - base) >> 3);
+  }
+#if defined(DUK_USE_ROM_OBJECTS)
+  for (const void* const* rom = duk_rom_compressed_pointers; *rom; rom ++) {
+    if (*rom == pointer) {
+      return (duk_uint16_t)(DUK_USE_ROM_PTRCOMP_FIRST + (rom - duk_rom_compressed_pointers));
+    }
+  }
+#endif
+  return 0;  // not reachable, Duktape only stores pointers into its own heap and ROM
+}
+
+extern "C" void* activityHeapDec16(void* udata, duk_uint16_t value) {
+  if (!value) {
+    return nullptr;
+  }
+#if defined(DUK_USE_ROM_OBJECTS)
+  if (value >= DUK_USE_ROM_PTRCOMP_FIRST) {
+    return (void*)duk_rom_compressed_pointers[value - DUK_USE_ROM_PTRCOMP_FIRST];
+  }
+#endif
+  return (void*)(((HeapPool*)udata)->base() + ((size_t)value << 3));
+}
+
+// Entry points for the ROM global object, named in lib/Duktape/flipdot_builtins.yaml
+extern "C" duk_ret_t flipdot_create_element(duk_context* ctx) { return window::createElement(ctx); }
+extern "C" duk_ret_t flipdot_set_attributes(duk_context* ctx) { return window::setAttributes(ctx); }
+extern "C" duk_ret_t flipdot_batch(duk_context* ctx) { return window::batch(ctx); }
+extern "C" duk_ret_t flipdot_request_animation_frame(duk_context* ctx) { return window::requestAnimationFrame(ctx); }
+extern "C" duk_ret_t flipdot_cancel_animation_frame(duk_context* ctx) { return window::cancelAnimationFrame(ctx); }
+extern "C" duk_ret_t flipdot_set_timeout(duk_context* ctx) { return window::setTimeout(ctx); }
+extern "C" duk_ret_t flipdot_set_interval(duk_context* ctx) { return window::setInterval(ctx); }
+extern "C" duk_ret_t flipdot_clear_timeout(duk_context* ctx) { return window::clearTimeout(ctx); }
+extern "C" duk_ret_t flipdot_print(duk_context* ctx) { return window::print(ctx); }
+#endif
+
+class Activity: public window::RootContainer {
+  duk_context *ctx = nullptr;
+
+  // Work for the script task, one script turn each
+  struct ScriptEvent {
+    enum Type {
+      FRAME_PRESENTED,
+      QUIT  // leave the loop and end the task, sent by the destructor
+    };
+
+    Type type;
+    window::PresentParameters present;
+    uint32_t at;  // millis() when queued
+  };
+
+  std::string name;
+  window::CommandBuffer commands;
+  window::ScriptTimers scriptTimers;
+  std::vector<uint32_t> dueTimers;
+  QueueHandle_t events;
+  TaskHandle_t scriptTask;  // cleared when the task ends
+  SemaphoreHandle_t taskExited;
+  ActivityHeap* heap = nullptr;
+
+  uint32_t startedAt;
+  uint32_t lastAnimationFrame;
+  uint32_t lastOverrunReport = 0;
+  volatile bool scriptsRan = false;
+  volatile bool framesWanted = false;  // the script has frame callbacks, otherwise only due timers wake it
+  bool firstFrameReported = false;
+
+public:
+
+  uint16_t eventsDropped = 0;
+  uint32_t callbackOverruns = 0;  // callbacks aborted for running past their budget
+  volatile bool startFinished = false;
+  uint32_t startTime = 0;         // ms from construction until the scripts had run
+  uint8_t scriptsCompiled = 0;
+  uint8_t scriptsCached = 0;
+
+  Activity(std::string name)
+  : name(name)
+  {
+    Serial.print("Starting activity ");
+    startedAt = millis();
+    lastAnimationFrame = startedAt;
+
+    events = xQueueCreate(ACTIVITY_EVENT_QUEUE, sizeof(ScriptEvent));
+    taskExited = xSemaphoreCreateBinary();
+    xTaskCreatePinnedToCore(runScript, "Activity", ACTIVITY_TASK_STACK, this, 1, &scriptTask, ACTIVITY_TASK_CORE);
+  }
+
+  // The script task is asked to quit and waited for, so it isn't stopped holding the tree lock or a file.
+  // The Duktape heap then goes with its pool in one free, without walking the heap
+  ~Activity() {
+    ScriptEvent event;
+    event.type = ScriptEvent::QUIT;
+    xQueueReset(events);  // frames it hasn't got to don't matter now, and the quit always fits
+    xQueueSend(events, &event, portMAX_DELAY);
+    xSemaphoreTake(taskExited, portMAX_DELAY);  // already given if the script never started
+    delete heap;
+    vQueueDelete(events);
+    vSemaphoreDelete(taskExited);
+  }
+
+  size_t heapInUse() {
+    return heap ? heap->inUse : 0;
+  }
+
+  size_t heapPeak() {
+    return heap ? heap->peak : 0;
+  }
+
+  const char* elementType() {
+    return "activity";
+  }
+
+  size_t objectSize() {
+    return sizeof(*this);
+  }
+
+  void lockTree() {
+    xSemaphoreTake(commands.treeLock, portMAX_DELAY);
+  }
+
+  void unlockTree() {
+    xSemaphoreGive(commands.treeLock);
+  }
+
+  void applyCommands() {
+    commands.apply();
+    if (scriptsRan && !firstFrameReported) {
+      firstFrameReported = true;
+      Serial.printf("Activity %s: first frame %lu ms after start, %s (%u compiled, %u from cache)\n", name.c_str(),
+        millis() - startedAt, scriptsCompiled ? "cold" : "warm", scriptsCompiled, scriptsCached);
+      Serial.printf("Activity %s: heap %u of %u bytes in %s, peak %u\n", name.c_str(), heap->inUse,
+        heap->getCapacity(), heap->inPsram ? "PSRAM" : "internal RAM", heap->peak);
+    }
+  }
+
+  // Queued for the script's onFramePresented(frame, time_since_submit), if it has one, and its due timers
+  void framePresented(window::PresentParameters params) {
+    if (!framesWanted && !scriptTimers.pending) {
+      window::RootContainer::framePresented(params);
+      return;  // an idle script's task stays asleep
+    }
+    ScriptEvent event;
+    event.type = ScriptEvent::FRAME_PRESENTED;
+    event.present = params;
+    event.at = millis();
+    if (xQueueSend(events, &event, 0) != pdTRUE) {
+      eventsDropped ++;  // script is behind, it only ever needs the latest frames
+    }
+    window::RootContainer::framePresented(params);
+  }
+
+private:
+
+  // The Duktape heap is created, used and only ever touched by this task
+  static void runScript(void* arg) {
+    Activity* activity = (Activity*)arg;
+    bool started = activity->startScript();
+    activity->startTime = millis() - activity->startedAt;
+    activity->startFinished = true;
+    if (started) {
+      activity->framesWanted = activity->wantsFrames();
+
+      ScriptEvent event;
+      while (true) {
+        if (xQueueReceive(activity->events, &event, portMAX_DELAY) != pdTRUE) {
+          continue;
+        }
+        if (event.type == ScriptEvent::QUIT) {
+          break;
+        }
+        activity->handleEvent(event);
+        activity->framesWanted = activity->wantsFrames();
+        activity->commands.publish();
+      }
+    }
+
+    activity->scriptTask = nullptr;
+    xSemaphoreGive(activity->taskExited);  // the activity may be gone from here on
+    vTaskDelete(nullptr);
+  }
+
+  bool startScript() {
+    heap = new ActivityHeap(ACTIVITY_HEAP_SIZE, ACTIVITY_HEAP_PSRAM && psramFound());
+    ctx = duk_create_heap(HeapPool::dukAlloc, HeapPool::dukRealloc, HeapPool::dukFree, (HeapPool*)heap, nullptr);
+    if (!ctx) { 
+      ///delete this; TODO: exit in bette way
+      return false;
+    }
+
+    duk_push_global_stash(ctx);
+    duk_push_pointer(ctx, (void*)&commands);
+    duk_put_prop_string(ctx, -2, "commandBuffer");
+    duk_push_pointer(ctx, (void*)&scriptTimers);
+    duk_put_prop_string(ctx, -2, "scriptTimers");
+    duk_pop(ctx);
+
+    window::registerElementPrototype(ctx);
+    commands.root = this;
+
+    duk_push_global_stash(ctx);
+    duk_push_object(ctx);
+    duk_put_prop_string(ctx, -2, "animationFrames");
+    duk_push_uint(ctx, 0);
+    duk_put_prop_string(ctx, -2, "animationFrameId");
+    duk_push_object(ctx);
+    duk_put_prop_string(ctx, -2, "timers");
+    duk_pop(ctx);
+
+    duk_push_global_object(ctx);
+
+    window::pushElementObject(ctx, this);
+    duk_put_prop_string(ctx, 0, "activity");
+
+#ifndef FLIPDOT_DUK_LOWMEM  // otherwise these are in the ROM global object
+    duk_push_c_function(ctx, window::createElement, 2);
+    duk_put_prop_string(ctx, 0, "createElement");
+
+    duk_push_c_function(ctx, window::setAttributes, 2);
+    duk_put_prop_string(ctx, 0, "setAttributes");
+
+    duk_push_c_function(ctx, window::batch, 1);
+    duk_put_prop_string(ctx, 0, "batch");
+
+    duk_push_c_function(ctx, window::requestAnimationFrame, 1);
+    duk_put_prop_string(ctx, 0, "requestAnimationFrame");
+
+    duk_push_c_function(ctx, window::cancelAnimationFrame, 1);
+    duk_put_prop_string(ctx, 0, "cancelAnimationFrame");
+
+    duk_push_c_function(ctx, window::setTimeout, 2);
+    duk_put_prop_string(ctx, 0, "setTimeout");
+
+    duk_push_c_function(ctx, window::setInterval, 2);
+    duk_put_prop_string(ctx, 0, "setInterval");
+
+    duk_push_c_function(ctx, window::clearTimeout, 1);
+    duk_put_prop_string(ctx, 0, "clearTimeout");
+
+    duk_push_c_function(ctx, window::clearTimeout, 1);
+    duk_put_prop_string(ctx, 0, "clearInterval");
+
+    duk_push_c_function(ctx, window::print, 1);
+    duk_put_prop_string(ctx, 0, "print");
+#endif
+    Serial.print("Loading JS");
+
+    ScriptLoader loader(ctx);
+    if (loader.loadPrelude()) {
+      loader.run(name.c_str());
+    }
+    scriptsCompiled = loader.compiled;
+    scriptsCached = loader.cached;
+
+    commands.publish();
+    scriptsRan = true;
+    Serial.print("Activity started");
+    return true;
+  }
+
+  // Call the function below its arguments on the stack within the callback budget, pops them
+  bool callWithBudget(duk_idx_t nargs, const char* what) {
+    heap->timedOut = false;
+    heap->deadline = (micros() + ACTIVITY_CALLBACK_BUDGET_US) | 1;
+    bool success = duk_pcall(ctx, nargs) == DUK_EXEC_SUCCESS;
+    heap->deadline = 0;
+
+    if (heap->timedOut) {
+      callbackOverruns ++;
+      uint32_t now = millis();
+      if (now - lastOverrunReport >= 1000) {
+        lastOverrunReport = now;
+        Serial.printf("Activity %s: %s overran its %u us budget, %lu overruns so far\n", name.c_str(), what,
+          ACTIVITY_CALLBACK_BUDGET_US, callbackOverruns);
+      }
+    } else if (!success) {
+      Serial.println(duk_safe_to_string(ctx, -1));
+    }
+    duk_pop(ctx);
+    return success;
+  }
+
+  // Run the callbacks requested before this frame - those they request wait for the next one
+  void runAnimationFrames(uint32_t at) {
+    duk_push_global_stash(ctx);
+    duk_get_prop_string(ctx, -1, "animationFrames");
+    duk_push_object(ctx);
+    duk_put_prop_string(ctx, -3, "animationFrames");
+
+    uint32_t elapsed = at - lastAnimationFrame;
+    lastAnimationFrame = at;
+    duk_enum(ctx, -1, DUK_ENUM_OWN_PROPERTIES_ONLY);
+    while (duk_next(ctx, -1, 1)) {
+      duk_remove(ctx, -2);  // id
+      duk_push_uint(ctx, elapsed);
+      callWithBudget(1, "requestAnimationFrame callback");
+    }
+    duk_pop_3(ctx);  // enumerator, callbacks, stash
+  }
+
+  // Every timer that came due since the last frame, in deadline order
+  void runTimers() {
+    if (!scriptTimers.pending) {
+      return;
+    }
+    scriptTimers.takeDue(dueTimers);
+    duk_push_global_stash(ctx);
+    duk_get_prop_string(ctx, -1, "timers");
+    for (uint32_t id : dueTimers) {
+      bool repeat;
+      if (!scriptTimers.fire(id, repeat)) {
+        continue;  // an earlier callback cleared it
+      }
+      duk_get_prop_index(ctx, -1, id);
+      if (!repeat) {
+        duk_del_prop_index(ctx, -2, id);
+      }
+      callWithBudget(0, repeat ? "setInterval callback" : "setTimeout callback");
+    }
+    duk_pop_2(ctx);  // timers, stash
+  }
+
+  // Whether the script has anything to run when a frame is shown, besides timers
+  bool wantsFrames() {
+    bool wanted = duk_get_global_string(ctx, "onFramePresented") && duk_is_callable(ctx, -1);
+    duk_pop(ctx);
+    if (!wanted) {
+      duk_push_global_stash(ctx);
+      duk_get_prop_string(ctx, -1, "animationFrames");
+      duk_enum(ctx, -1, DUK_ENUM_OWN_PROPERTIES_ONLY);
+      wanted = duk_next(ctx, -1, 0);
+      if (wanted) {
+        duk_pop(ctx);  // key
+      }
+      duk_pop_3(ctx);  // enumerator, callbacks, stash
+    }
+    return wanted;
+  }
+
+  void handleEvent(const ScriptEvent& event) {
+    switch (event.type) {
+      case ScriptEvent::FRAME_PRESENTED: {
+        bool animating = framesWanted;  // otherwise only timers woke the task
+        runTimers();
+        if (duk_get_global_string(ctx, "onFramePresented") && duk_is_callable(ctx, -1)) {
+          duk_push_uint(ctx, event.present.frame);
+          duk_push_uint(ctx, event.present.time_since_submit);
+          callWithBudget(2, "onFramePresented");
+        } else {
+          duk_pop(ctx);
+        }
+        if (animating) {
+          runAnimationFrames(event.at);
+        } else {
+          lastAnimationFrame = event.at;  // callbacks requested by timers wait for the next frame
+        }
+        break;
+      }
+      case ScriptEvent::QUIT:
+        break;  // handled by runScript()
+    }
+  }
+};
+
+/*
+class Scroller: public WindowElement {
+
+  uint16_t stepRemaining = 0;
+  
+public:
+
+  uint8_t scrollerViewSize;
+
+  uint16_t scrollerSize;
+
+  int16_t position = 0;
+  int16_t targetPosition = 0;
+
+  bool vertical;
+
+  struct segment {
+    uint8_t start;
+    uint8_t size;
+    WindowElement* source;
+  };
+
+  std::vector<segment> segments;
+
+  uint16_t getScrollerSize() {
+    uint16_t size = 0;
+    for (auto& segment : segments) {
+      size += segment.size;
+    }
+    return size;
+  }
+
+  void limitPosition() {
+    while (position + scrollerViewSize  > scrollerSize) {
+      position -= scrollerSize;
+    } 
+    return;
+    while (position - scrollerViewSize  < -1*scrollerSize) {
+      position += scrollerSize;
+    }
+    return;
+  }
+
+  void buildSegments(int16_t position) {
+    int16_t elementLowerPosition = -1*scrollerSize;
+    uint8_t elementIndex = 0;
+    WindowElement* currentElement;
+
+    scrollerSize = getScrollerSize();
+    limitPosition();
+
+    if (vertical) {
+      elementLowerPosition += components[0]->size_y;
+    } else {
+      elementLowerPosition += components[0]->size_x;
+    }
+
+    while (elementLowerPosition < position) {
+      elementIndex ++;
+      elementIndex = elementIndex % components.size();
+      currentElement = components[elementIndex];
+      if (vertical) {
+        elementLowerPosition += currentElement->size_y;
+      } else {
+        elementLowerPosition += currentElement->size_x;
+      }
+    }
+
+    segments.clear();
+
+    while (elementLowerPosition <= position + scrollerViewSize) {
+      segment nextSegment;
+      currentElement = components[elementIndex];
+      nextSegment.source = currentElement;
+      if (vertical) {
+        nextSegment.start = elementLowerPosition - currentElement->size_y;
+        nextSegment.size = currentElement->size_y;
+      } else {
+        nextSegment.start = elementLowerPosition - currentElement->size_x;
+        nextSegment.size = currentElement->size_x;
+      }
+      segments.push_back(nextSegment); // right vector order?
+
+      elementIndex ++;
+      elementIndex = elementIndex % components.size();
+      currentElement = components[elementIndex];
+
+      if (vertical) {
+        elementLowerPosition += currentElement->size_y;
+      } else {
+        elementLowerPosition += currentElement->size_x;
+      }
+    }
+  }
+
+  void updateScroller(int16_t position = 0) {
+    buildSegments(position);
+  }
+
+  Scroller(bool vertical = true)
+  : vertical(vertical)
+  {
     if (vertical) {
       scrollerViewSize = size_y;
     } else {
@@ -709,21 +2162,535 @@ public:
 };
 */
 
-class FlipDisplay {
+#define MODULES 8
+#define FRAME_INTERVAL_MS 16
+#define FLIP_BUDGET_PER_MS 6      // whole chain; one module flips at most ~2 dots per ms
+#define PRESENT_QUEUE 4
+
+// Panel mounting, quarter turns clockwise and a left-right mirror - applied when the frame is packed
+#define DISPLAY_ROTATION 0
+#define DISPLAY_MIRROR false
+
+// Driver board register 8 value for vertical columns, LSB left, LSB bottom - the driver's fast path
+#define DRIVER_NATIVE_RASTER 0b0001
+
+// Driver board pulse timing, see setPulseTiming() and register 9 in the driver board firmware
+#define DRIVER_DEAD_TIME_US 10
+#define DRIVER_SATURATION_TIME_US 500  // until register 9 is written
+#define DRIVER_SWEEP_SLOTS 100         // DUTCY_CYCLE_RATIO
+#define DRIVER_PIXEL_SLOTS 35
+
+#define TELEMETRY_POLL_MS 144  // one module per poll, between frames
+#define TELEMETRY_PACKET_SEPTETS 37
+
+// Link mode, see driver board registers 13 and 14
+#define LINK_RATE_COUNT 3
+#define LINK_ERROR_LIMIT 8          // bad bursts reported by one module between polls before falling back
+#define LINK_SILENCE_MS 2000        // driver boards fall back to 115200 after this long without a good burst
+#define LINK_KEEPALIVE_MS 500       // so every module gets a burst at least this often
+#define LINK_CHECK_MS 100           // verify and keepalive checks while the link is up
+
+const unsigned long linkRates[LINK_RATE_COUNT] = {115200, 250000, 500000};
+
+// Driver board telemetry reply (register 12), see the driver board protocol description
+struct ModuleTelemetry {
+  bool valid = false;
+  unsigned long receivedAt = 0;
+  uint16_t sweepCount = 0;
+  uint32_t pulsesIssued = 0;
+  uint16_t framesDropped = 0;
+  uint16_t rxOverruns = 0;
+  uint16_t saturationTime = 0;
+  uint16_t isrLatencyMax = 0;
+  uint16_t preloadUnderruns = 0;
+  uint32_t flipTotal = 0;
+  uint16_t flipMax = 0;
+  uint8_t flipMaxDot = 0;
+  uint16_t crcErrors = 0;
+  uint8_t linkRate = 0;
+};
+
+// UART chain of driver boards, one module per 5 columns
+class FlipDisplay: public DisplayBackend {
+
+  // Telemetry reply parser
+  int8_t telemetryModule = -1;
+  uint8_t telemetryPacket[TELEMETRY_PACKET_SEPTETS];
+  uint8_t telemetryLength = 0;
+  uint8_t telemetryPollModule = 0;
+  WheelTimer telemetryTimer;
+  volatile bool telemetryPollDue = false;
+
+  static uint32_t readSeptets(const uint8_t* packet, uint8_t &offset, uint8_t count) {
+    uint32_t value = 0;
+    for (uint8_t i = 0; i < count; i++) {
+      value |= (uint32_t)packet[offset + i] << (7 * i);
+    }
+    offset += count;
+    return value;
+  }
+
+  // Flip budget
+  // Columns as last sent to the driver boards. Dots that differ from the
+  // rendered frame are flips the boards will make on their next sweep, so
+  // each frame only sends as many changes as the budget allows and the rest
+  // follow on later frames. Small updates fit the budget and go straight out.
+  uint8_t sentColumns[MODULES * 5] = {0};
+  uint8_t flipStartModule = 0;
+
+  // Move up to budget dots of sentColumns towards the rendered frame
+  uint16_t scheduleFlips(const PackedFrame& frame, uint8_t* columns, bool (&moduleChanged)[MODULES], uint16_t budget) {
+    uint16_t pending = 0;
+    for (int x = 0; x < MODULES * 5; x ++) {
+      columns[x] = frame.columns[x] & 0b01111111;
+      pending += __builtin_popcount(columns[x] ^ sentColumns[x]);
+    }
+    if (pending <= budget || fullRedraw) {  // register 7 has the boards pulse every dot whatever is sent, in either mode
+      for (int module = 0; module < MODULES; module ++) {
+        moduleChanged[module] = fullRedraw || memcmp(&columns[module * 5], &sentColumns[module * 5], 5);
+      }
+      memcpy(sentColumns, columns, sizeof(sentColumns));
+      flipsDeferred = 0;
+      return pending;
+    }
+
+    // Over budget - start from a different module each frame so none is starved
+    uint16_t sent = 0;
+    for (int i = 0; i < MODULES; i ++) {
+      int module = (flipStartModule + i) % MODULES;
+      moduleChanged[module] = false;
+      for (int x = 0; x < 5; x ++) {
+        uint8_t diff = columns[module * 5 + x] ^ sentColumns[module * 5 + x];
+        while (diff && __builtin_popcount(diff) > budget - sent) {
+          diff &= diff - 1;
+        }
+        if (diff) {
+          sentColumns[module * 5 + x] ^= diff;
+          sent += __builtin_popcount(diff);
+          moduleChanged[module] = true;
+        }
+        columns[module * 5 + x] = sentColumns[module * 5 + x];
+      }
+    }
+    flipStartModule = (flipStartModule + 1) % MODULES;
+    flipsDeferred = pending - sent;
+    return sent;
+  }
+
+  // Flip completion model
+  // Mirrors the driver boards' pulse timing for the register 9 rate we set.
+  // A board picks up a frame at the start of its next sweep and has latched
+  // every dot by the end of that sweep's pixel slots, so a frame is on the
+  // dots at most a sweep plus the pixel slots after its last byte arrives.
+  uint16_t saturationTime = DRIVER_SATURATION_TIME_US;
+  uint32_t frameCount = 0;
+
+  struct PendingPresent {
+    uint32_t frame;
+    uint32_t submittedAt;
+    uint32_t presentAt;
+  };
+  PendingPresent presentQueue[PRESENT_QUEUE];
+  uint8_t presentHead = 0;
+  uint8_t presentCount = 0;
+
+  void queuePresent(uint32_t submittedAt, uint32_t presentAt) {
+    if (presentCount == PRESENT_QUEUE) {  // can't happen while pacing holds, report the oldest early
+      presentHead = (presentHead + 1) % PRESENT_QUEUE;
+      presentCount --;
+    }
+    PendingPresent& present = presentQueue[(presentHead + presentCount) % PRESENT_QUEUE];
+    present.frame = frameCount;
+    present.submittedAt = submittedAt;
+    present.presentAt = presentAt;
+    presentCount ++;
+  }
+
+  // Notify the element tree of every frame whose dots have settled
+  void presentDue() {
+    while (presentCount && (int32_t)(micros() - presentQueue[presentHead].presentAt) >= 0) {
+      PendingPresent& present = presentQueue[presentHead];
+      window::PresentParameters params;
+      params.frame = present.frame;
+      params.time_since_submit = (present.presentAt - present.submittedAt) / 1000;
+      presentHead = (presentHead + 1) % PRESENT_QUEUE;
+      presentCount --;
+      frameBuffer->framePresented(params);
+    }
+  }
+
+  // Ticks until the next present is due, capped at limit
+  TickType_t presentWait(TickType_t limit) {
+    if (!presentCount) {
+      return limit;
+    }
+    int32_t remaining = presentQueue[presentHead].presentAt - micros();
+    if (remaining <= 0) {
+      return 0;
+    }
+    TickType_t ticks = pdMS_TO_TICKS((remaining + 999) / 1000);
+    return ticks < limit ? ticks : limit;
+  }
+
+  void decodeTelemetry() {
+    uint8_t checksum = 0;
+    for (uint8_t i = 0; i < TELEMETRY_PACKET_SEPTETS - 1; i++) {
+      checksum += telemetryPacket[i];
+    }
+    if ((checksum & 0b01111111) != telemetryPacket[TELEMETRY_PACKET_SEPTETS - 1]) {
+      return;
+    }
+    ModuleTelemetry& module = telemetry[telemetryModule];
+    uint8_t offset = 0;
+    module.sweepCount = readSeptets(telemetryPacket, offset, 3);
+    module.pulsesIssued = readSeptets(telemetryPacket, offset, 5);
+    module.framesDropped = readSeptets(telemetryPacket, offset, 3);
+    module.rxOverruns = readSeptets(telemetryPacket, offset, 3);
+    module.saturationTime = readSeptets(telemetryPacket, offset, 3);
+    module.isrLatencyMax = readSeptets(telemetryPacket, offset, 3);
+    module.preloadUnderruns = readSeptets(telemetryPacket, offset, 3);
+    module.flipTotal = readSeptets(telemetryPacket, offset, 5);
+    module.flipMax = readSeptets(telemetryPacket, offset, 3);
+    module.flipMaxDot = readSeptets(telemetryPacket, offset, 1);
+    uint16_t previousCrcErrors = module.crcErrors;
+    module.crcErrors = readSeptets(telemetryPacket, offset, 3);
+    module.linkRate = readSeptets(telemetryPacket, offset, 1);
+    if (linkRate && module.valid && (uint16_t)(module.crcErrors - previousCrcErrors) >= LINK_ERROR_LIMIT) {
+      linkFailed = true;
+    }
+    if (linkRate && module.linkRate != linkRate) {  // it already gave up on the faster rate
+      linkFailed = true;
+    }
+    module.receivedAt = millis();
+    module.valid = true;
+  }
+
+  // Link mode
+  // Switching up is a plain register 13 write to every module at 115200,
+  // after which frames and register writes go out as CRC-checked bursts.
+  // Modules that stop hearing good bursts drop back to 115200 on their own;
+  // the controller drops back when telemetry shows errors or goes quiet.
+  uint8_t linkRate = 0;
+  int8_t linkRequested = -1;
+  bool linkFailed = false;
+  unsigned long linkSwitchedAt = 0;
+  // The timers only raise flags, the display task acts on them between frames so nothing lands mid-frame
+  WheelTimer linkRetryTimer;
+  WheelTimer linkCheckTimer;
+  volatile bool linkRetryDue = false;
+  volatile bool linkCheckDue = false;
+  bool linkCapable[MODULES] = {false};  // answered telemetry before the switch, so must answer after it
+  unsigned long lastBurst[MODULES] = {0};
+
+  uint8_t crc7(uint8_t crc, uint8_t val) {  // CRC-7, x^7 + x^3 + 1, as the driver boards check it
+    for (uint8_t bit = 0; bit < 8; bit++) {
+      crc <<= 1;
+      if ((val ^ crc) & 0x80) {
+        crc ^= 0x09;
+      }
+      val <<= 1;
+    }
+    return crc & 0b01111111;
+  }
+
+  uint16_t writeBurst(uint8_t module, const uint8_t* payload, uint8_t length) {
+    uint8_t crc = crc7(0, length);
+    Serial2.write(0b10001110 | (module << 4));
+    Serial2.write(length);
+    for (uint8_t i = 0; i < length; i++) {
+      Serial2.write(payload[i]);
+      crc = crc7(crc, payload[i]);
+    }
+    Serial2.write(crc);
+    lastBurst[module] = millis();
+    return length + 3;
+  }
+
+  uint16_t writeRegister(uint8_t module, uint8_t reg, uint8_t value) {
+    if (linkRate) {
+      uint8_t payload[2] = {reg, value};
+      return writeBurst(module, payload, 2);
+    }
+    Serial2.write(0b10000000 | (module << 4) | reg);
+    Serial2.write(value);
+    return 2;
+  }
+
+  uint16_t writeFrame(uint8_t module, const uint8_t* frameColumns) {
+    uint8_t columns[5];
+    for (int x = 0; x < 5; x ++) {
+      columns[x] = reverse8(frameColumns[x]) >> 1;  // packed frames are top first, the drivers bottom first
+    }
+    if (linkRate) {
+      uint16_t txBytes = 0;
+      if (fullRedraw) {
+        Serial2.write(0b10000111 | (module << 4));  // register 7 acts on selection, no write needed
+        txBytes ++;
+      }
+      uint8_t payload[6] = {0};
+      memcpy(&payload[1], columns, 5);
+      return txBytes + writeBurst(module, payload, 6);
+    }
+    Serial2.write(0b10000000 | (module << 4));
+    Serial2.write(columns, 5);
+    if (fullRedraw) {
+      Serial2.write(0b10000111 | (module << 4));  // ends the write like register 5 does, and pulses every dot
+    }
+    else {
+      Serial2.write(0b10000101 | (module << 4));
+    }
+    return 7;
+  }
+
+  void switchLink(uint8_t rate) {
+    for (int module = 0; module < MODULES; module ++) {
+      writeRegister(module, 13, rate);
+    }
+    Serial2.flush();
+    vTaskDelay(2 / portTICK_PERIOD_MS);  // every module has switched before we talk at the new rate
+    Serial2.updateBaudRate(linkRates[rate]);
+    linkRate = rate;
+    linkSwitchedAt = millis();
+    linkFailed = false;
+    for (int module = 0; module < MODULES; module ++) {
+      linkCapable[module] = telemetry[module].valid;
+      lastBurst[module] = linkSwitchedAt;
+    }
+    if (rate) {
+      timers.start(linkCheckTimer, LINK_CHECK_MS, LINK_CHECK_MS);
+    } else {
+      timers.cancel(linkCheckTimer);  // nothing to check at 115200
+      linkCheckDue = false;
+    }
+  }
+
+  // Link rate changes, fallback and keepalives - called by the display task between frames
+  uint16_t serviceLink() {
+    uint16_t txBytes = 0;
+    unsigned long now = millis();
+    bool checkDue = linkCheckDue;
+    linkCheckDue = false;
+
+    if (linkRate) {
+      uint32_t verifyTime = 2UL * MODULES * (TELEMETRY_POLL_MS + frameInterval());  // polls wait for a frame boundary
+      if (checkDue && now - linkSwitchedAt > verifyTime) {
+        for (int module = 0; module < MODULES; module ++) {
+          if (linkCapable[module] && (long)(telemetry[module].receivedAt - linkSwitchedAt) < 0) {
+            linkFailed = true;  // polled at least twice since the switch without a reply
+          }
+        }
+      }
+      if (linkFailed) {
+        uint8_t failedRate = linkRate;
+        switchLink(0);
+        linkFallbacks ++;
+        linkRequested = failedRate > 1 ? failedRate - 1 : -1;
+        linkRetryDue = false;
+        if (linkRequested >= 0) {
+          timers.start(linkRetryTimer, LINK_SILENCE_MS + 500);  // modules that missed the fallback time out first
+        }
+        fullRedraw = true;
+        return txBytes;
+      }
+    }
+
+    if (linkRetryDue) {
+      linkRetryDue = false;
+      if (linkRequested < 0) {
+        return txBytes;
+      }
+      uint8_t rate = linkRequested;
+      linkRequested = -1;
+      if (rate != linkRate) {
+        if (linkRate) {
+          switchLink(0);
+        }
+        if (rate) {
+          switchLink(rate);
+        }
+        fullRedraw = true;
+      }
+      return txBytes;
+    }
+
+    if (linkRate && checkDue) {
+      for (int module = 0; module < MODULES; module ++) {
+        if (now - lastBurst[module] > LINK_KEEPALIVE_MS) {
+          uint8_t noop = 15;  // start register only, writes nothing
+          txBytes += writeBurst(module, &noop, 1);
+        }
+      }
+    }
+    return txBytes;
+  }
 
 public:
 
   bool fullRedraw = false;
 
+  // Every output the display task presents frames to, the driver chain itself included
+  BackendGroup backends;
+
+  // Serial bytes already sent in the current frame, before the frame data
+  uint16_t frameTxBytes = 0;
+
+  // Global flip rate limit, keeps the coil current of the whole chain under what the supply can deliver
+  uint16_t flipBudgetPerMs = FLIP_BUDGET_PER_MS;
+  uint16_t flipsDeferred = 0;  // changes held back to later frames
+
+  ModuleTelemetry telemetry[MODULES];
+
+  // Driver board scan order (register 10), sent by the display task so it can't interleave with a frame
+  int16_t pendingScanOrder = -1;
+  // Driver board frame rate (register 9), likewise
+  int16_t pendingFrameRate = -1;
+
+  // Predicted micros() at which each module has latched the last frame sent to it
+  uint32_t presentedAt[MODULES] = {0};
+
+  uint16_t linkFallbacks = 0;
+
+  Orientation orientation;
+  bool repack = false;  // pack the frame again even if the tree is clean
+  // Driver board display configuration (register 8), sent by the display task on begin
+  bool pendingRasterConfig = false;
+
   window::Element* frameBuffer;
 
-  FlipDisplay()
+  FlipDisplay():
+    telemetryTimer([](void* arg) { ((FlipDisplay*)arg)->telemetryPollDue = true; }, this),
+    linkRetryTimer([](void* arg) { ((FlipDisplay*)arg)->linkRetryDue = true; }, this),
+    linkCheckTimer([](void* arg) { ((FlipDisplay*)arg)->linkCheckDue = true; }, this)
   {
-    
+    orientation.rotation = DISPLAY_ROTATION;
+    orientation.mirror = DISPLAY_MIRROR;
+    backends.add(this);
   }
 
   void begin() {
     fullRedraw = true;
+    pendingRasterConfig = true;
+    timers.start(telemetryTimer, TELEMETRY_POLL_MS, TELEMETRY_POLL_MS);
+  }
+
+  // Size the activity should render at for the current orientation
+  uint8_t logicalWidth() {
+    return orientation.logicalWidth(MODULES * 5, 7);
+  }
+
+  uint8_t logicalHeight() {
+    return orientation.logicalHeight(MODULES * 5, 7);
+  }
+
+  void setOrientation(uint8_t rotation, bool mirror = false) {
+    orientation.rotation = rotation & 0b11;
+    orientation.mirror = mirror;
+    repack = true;
+    fullRedraw = true;
+  }
+
+  // Scan order and scroll direction as defined for driver board register 10
+  void setScanOrder(uint8_t scanOrder, uint8_t scrollDirection = 0) {
+    pendingScanOrder = (scanOrder & 0b111) | ((scrollDirection & 0b11) << 3);
+  }
+
+  // Link rate as defined for driver board register 13 - falls back to a lower rate on errors
+  void setLinkRate(uint8_t rate) {
+    linkRequested = constrain(rate, 0, LINK_RATE_COUNT - 1);
+    timers.start(linkRetryTimer, 0);
+  }
+
+  uint8_t getLinkRate() {
+    return linkRate;
+  }
+
+  // Serial time per byte in us at the current link rate
+  uint32_t byteTime() {
+    return (10 * 1000000UL + linkRates[linkRate] - 1) / linkRates[linkRate];
+  }
+
+  // Send a frame down the chain, within the flip budget, and predict when it will have settled
+  void present(const PackedFrame& frame, const Damage& damage) {
+    uint16_t txBytes = frameTxBytes;
+    uint8_t columns[MODULES * 5];
+    bool moduleChanged[MODULES];
+    scheduleFlips(frame, columns, moduleChanged, flipBudgetPerMs * frameInterval());
+
+    uint32_t submittedAt = micros();
+    uint32_t settleTime = sweepTime() + DRIVER_PIXEL_SLOTS * (uint32_t)(saturationTime + DRIVER_DEAD_TIME_US);
+    uint32_t presentAt = submittedAt;
+    for (int module = 0; module < MODULES; module ++) {
+      if (!moduleChanged[module]) {
+        if ((int32_t)(presentedAt[module] - presentAt) > 0) {
+          presentAt = presentedAt[module];  // still flipping an earlier frame
+        }
+        continue;
+      }
+      txBytes += writeFrame(module, &columns[module * 5]);
+      presentedAt[module] = submittedAt + txBytes * byteTime() + settleTime;
+      if ((int32_t)(presentedAt[module] - presentAt) > 0) {
+        presentAt = presentedAt[module];
+      }
+    }
+    frameCount ++;
+    queuePresent(submittedAt, presentAt);
+    fullRedraw = false;
+    pollTelemetry();
+  }
+
+  // Frames per second as defined for driver board register 9
+  void setFrameRate(uint8_t frameRate) {
+    pendingFrameRate = constrain(frameRate, 1, 127);
+  }
+
+  // Same calculation as the driver board's register 9 handler
+  static uint16_t saturationTimeFor(uint8_t frameRate) {
+    int usPerFlip = (1000000 / DRIVER_SWEEP_SLOTS) / frameRate;
+    usPerFlip -= 2 * DRIVER_DEAD_TIME_US;
+    return constrain(usPerFlip, 1, 5000);
+  }
+
+  // Time a driver board takes for one pass over its frame, in us
+  uint32_t sweepTime() {
+    return DRIVER_SWEEP_SLOTS * (uint32_t)(saturationTime + DRIVER_DEAD_TIME_US);
+  }
+
+  // Frames are never submitted faster than the boards can sweep them
+  uint16_t frameInterval() {
+    uint16_t sweepMs = (sweepTime() + 999) / 1000;
+    return sweepMs > FRAME_INTERVAL_MS ? sweepMs : FRAME_INTERVAL_MS;
+  }
+
+  // Collect telemetry replies from the driver boards' return line
+  void receiveTelemetry() {
+    while (Serial2.available()) {
+      uint8_t incomingByte = Serial2.read();
+      if (incomingByte & 0b10000000) {
+        if ((incomingByte & 0b00001111) == 12) {
+          telemetryModule = (incomingByte & 0b01110000) >> 4;
+          telemetryLength = 0;
+        } else {
+          telemetryModule = -1;  // our own traffic echoed on a half-duplex line
+        }
+      } else if (telemetryModule >= 0) {
+        telemetryPacket[telemetryLength] = incomingByte;
+        telemetryLength ++;
+        if (telemetryLength == TELEMETRY_PACKET_SEPTETS) {
+          decodeTelemetry();
+          telemetryModule = -1;
+        }
+      }
+    }
+  }
+
+  // Ask one module for telemetry each time the poll timer has fired, round robin
+  void pollTelemetry() {
+    if (!telemetryPollDue) {
+      return;
+    }
+    telemetryPollDue = false;
+    Serial2.write(0b10001011 | (telemetryPollModule << 4));
+    telemetryPollModule = (telemetryPollModule + 1) % MODULES;
   }
 
   static void updateDisplay(void *arg) { 
@@ -731,29 +2698,75 @@ public:
     FlipDisplay* display = (FlipDisplay*)arg;
 
     window::RenderParameters params;
-    params.time_since_last_render = 16;
+    PackedFrame frame;
+    unsigned long lastRender = millis();
+    TickType_t lastWake = xTaskGetTickCount();
 
     while(true) {
-      display->frameBuffer->render(params);
-
-      for (int module = 0; module < 8; module ++) {
-        Serial2.write(0b10000000 | (module << 4));
-        for (int x = 0; x < 5; x ++) {
-          uint8_t colBuf = 0;
-          for (int y = 0; y < 7; y ++) {
-            colBuf |= display->frameBuffer->getPixel(x + module * 5, y) << y;
-          }
-          Serial2.write(colBuf);
+      uint16_t txBytes = display->serviceLink();
+
+      if (display->pendingRasterConfig) {
+        display->pendingRasterConfig = false;
+        for (int module = 0; module < MODULES; module ++) {
+          txBytes += display->writeRegister(module, 8, DRIVER_NATIVE_RASTER);
+        }
+      }
+
+      if (display->pendingScanOrder >= 0) {
+        uint8_t scanOrder = display->pendingScanOrder;
+        display->pendingScanOrder = -1;
+        for (int module = 0; module < MODULES; module ++) {
+          txBytes += display->writeRegister(module, 10, scanOrder);
         }
-        if (display->fullRedraw) {
-          Serial2.write(0b10000110 | (module << 4));
+      }
+
+      if (display->pendingFrameRate >= 0) {
+        uint8_t frameRate = display->pendingFrameRate;
+        display->pendingFrameRate = -1;
+        for (int module = 0; module < MODULES; module ++) {
+          txBytes += display->writeRegister(module, 9, frameRate);
         }
-        else {
-          Serial2.write(0b10000101 | (module << 4));
+        display->saturationTime = saturationTimeFor(frameRate);
+      }
+
+      unsigned long now = millis();
+      params.time_since_last_render = now - lastRender;
+      lastRender = now;
+      // The script task never sees the tree mid-frame, and its changes land all at once
+      // A clean tree costs one flag check, the last packed frame is sent again
+      display->frameBuffer->lockTree();
+      display->frameBuffer->applyCommands();
+      if (display->frameBuffer->renderIfDirty(params) || display->repack) {
+        display->repack = false;
+        LogicalFrame logical(display->logicalWidth(), display->logicalHeight());
+        for (int x = 0; x < logical.width; x ++) {
+          for (int y = 0; y < logical.height; y ++) {
+            logical.setPixel(x, y, display->frameBuffer->getPixel(x, y));
+          }
+        }
+        orientFrame(logical, display->orientation, frame);
+      }
+      display->frameBuffer->unlockTree();
+      display->frameTxBytes = txBytes;
+      display->backends.submit(frame);
+      uint16_t interval = display->frameInterval();
+
+      // Wait out the frame interval, delivering presents as their dots settle
+      TickType_t frameTicks = pdMS_TO_TICKS(interval);
+      while (true) {
+        display->receiveTelemetry();
+        display->presentDue();
+        TickType_t elapsed = xTaskGetTickCount() - lastWake;
+        if (elapsed >= frameTicks) {
+          break;
         }
+        TickType_t wait = display->presentWait(frameTicks - elapsed);
+        vTaskDelay(wait ? wait : 1);
+      }
+      lastWake += frameTicks;
+      if (xTaskGetTickCount() - lastWake >= frameTicks) {
+        lastWake = xTaskGetTickCount();  // fell a whole frame behind, don't try to catch up
       }
-      display->fullRedraw = false;
-      vTaskDelay(16/portTICK_PERIOD_MS );
     }
   }
   
@@ -766,15 +2779,18 @@ Activity* test;
 bool tick = false;
 
 static void inputSimulator(void* arg) {
+  display.frameBuffer->lockTree();
   if (tick){ 
     display.frameBuffer->handleInput(window::DOWN_SINGLE);
   } else {
     display.frameBuffer->handleInput(window::UP_SINGLE);
   }
+  display.frameBuffer->unlockTree();
   tick = !tick;
 }
 
 static void input(int pin, void *arg) {
+  display.frameBuffer->lockTree();
   switch(pin) {
     case INPUT_UP:
       display.frameBuffer->handleInput(window::UP_SINGLE);
@@ -792,18 +2808,70 @@ static void input(int pin, void *arg) {
       display.frameBuffer->handleInput(window::CENTER_SINGLE);
       break;
   }
+  display.frameBuffer->unlockTree();
 }
 
 TaskHandle_t displayTask;
 
+#ifdef ACTIVITY_BENCHMARK
+// Start ACTIVITY_BENCHMARK copies of an activity side by side and report what each one costs
+static void benchmarkActivities() {
+  Activity* activities[ACTIVITY_BENCHMARK];
+  size_t freeBefore = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+  for (int i = 0; i < ACTIVITY_BENCHMARK; i ++) {
+    activities[i] = new Activity("test.main");
+    while (!activities[i]->startFinished) {
+      vTaskDelay(1);
+    }
+  }
+  size_t freeAfter = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+
+  uint32_t startTime = 0;
+  size_t heapInUse = 0;
+  size_t heapPeak = 0;
+  for (int i = 0; i < ACTIVITY_BENCHMARK; i ++) {
+    startTime += activities[i]->startTime;
+    heapInUse += activities[i]->heapInUse();
+    if (activities[i]->heapPeak() > heapPeak) {
+      heapPeak = activities[i]->heapPeak();
+    }
+  }
+#ifdef FLIPDOT_DUK_LOWMEM
+  const char* profile = "lowmem";
+#else
+  const char* profile = "default";
+#endif
+  Serial.printf("Activity benchmark, %s profile, %d activities: %u bytes of Duktape heap each (peak %u), "
+    "%lu ms to start each, %u bytes of system RAM each including the %u byte pool\n", profile, ACTIVITY_BENCHMARK,
+    heapInUse / ACTIVITY_BENCHMARK, heapPeak, startTime / ACTIVITY_BENCHMARK, (freeBefore - freeAfter) / ACTIVITY_BENCHMARK,
+    ACTIVITY_HEAP_SIZE);
+
+  for (int i = 0; i < ACTIVITY_BENCHMARK; i ++) {
+    delete activities[i];
+  }
+}
+#endif
+
 void setup() {
   Serial.begin(115200);
   Serial2.begin(115200);
+  timers.begin(TIMER_TASK_PRIORITY, TIMER_TASK_CORE);
+
+#ifdef ACTIVITY_BENCHMARK
+  benchmarkActivities();
+#endif
 
   test = new Activity("test.main");
 
   display.frameBuffer = test;
 
+  #ifdef OLED_DISPLAY
+    oled.begin(SSD1306_SWITCHCAPVCC, 0x3C);
+    oled.clearDisplay();
+    oled.display();
+    display.backends.add(&oledMirror);
+  #endif
+
   display.begin(); 
 
   xTaskCreatePinnedToCore (
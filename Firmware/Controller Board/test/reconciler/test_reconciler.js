@@ -0,0 +1,236 @@
+// reconcile() and the longest increasing run it keeps in place, from data/activityInit.js.
+// Runs on the host under node, with mock elements standing in for the natives:
+//   node test/reconciler/test_reconciler.js
+
+var fs = require("fs");
+var path = require("path");
+
+var failures = 0;
+
+function check(condition, message) {
+  if (!condition) {
+    failures++;
+    console.log("FAIL " + message);
+  }
+}
+
+// Mock natives, keeping children in step as the real ones do
+var ops;
+var nextId = 1;
+
+function resetOps() {
+  ops = {create: 0, remove: 0, move: 0, set: 0};
+}
+
+function MockElement(type) {
+  this.type = type;
+  this.id = nextId++;
+  this.attrs = {};
+  this.children = [];
+  this.dead = false;
+}
+
+MockElement.prototype.removeChild = function (child) {
+  var at = this.children.indexOf(child);
+  check(at >= 0, "removeChild of a stranger");
+  this.children.splice(at, 1);
+  (function kill(element) {
+    element.dead = true;
+    element.children.forEach(kill);
+  })(child);
+  ops.remove++;
+};
+
+MockElement.prototype.moveChild = function (child, index) {
+  var at = this.children.indexOf(child);
+  check(at >= 0, "moveChild of a stranger");
+  this.children.splice(at, 1);
+  this.children.splice(Math.min(index, this.children.length), 0, child);
+  ops.move++;
+};
+
+MockElement.prototype.setAttributes = function (attributes) {
+  check(!this.dead, "setAttributes on a removed element");
+  for (var name in attributes) {
+    this.attrs[name] = attributes[name];
+  }
+  this.childrenWhenSet = this.children.length;
+  ops.set++;
+};
+
+var sandbox = {
+  createElement: function (parent, type) {
+    var element = new MockElement(type);
+    parent.children.push(element);
+    ops.create++;
+    return element;
+  },
+  batch: function (fn) {
+    return fn();
+  },
+  print: function () {}
+};
+
+var source = fs.readFileSync(path.join(__dirname, "../../data/activityInit.js"), "utf8");
+var init = new Function("createElement", "batch", "print",
+  source + "\nreturn {reconcile: reconcile, stablePositions: stablePositions};");
+var activity = init(sandbox.createElement, sandbox.batch, sandbox.print);
+var reconcile = activity.reconcile;
+var stablePositions = activity.stablePositions;
+
+var seed = 1;
+function random(n) {
+  seed = (seed * 1103515245 + 12345) & 0x7fffffff;
+  return seed % n;
+}
+
+// Length of the longest increasing run, the slow way
+function longestRun(sequence) {
+  var best = [];
+  var longest = 0;
+  for (var i = 0; i < sequence.length; i++) {
+    if (sequence[i] < 0) {
+      continue;
+    }
+    best[i] = 1;
+    for (var j = 0; j < i; j++) {
+      if (sequence[j] >= 0 && sequence[j] < sequence[i] && best[j] + 1 > best[i]) {
+        best[i] = best[j] + 1;
+      }
+    }
+    longest = Math.max(longest, best[i]);
+  }
+  return longest;
+}
+
+function stableList(sequence) {
+  var stable = stablePositions(sequence);
+  var positions = [];
+  for (var i = 0; i < sequence.length; i++) {
+    if (stable[i]) {
+      positions.push(i);
+    }
+  }
+  return positions;
+}
+
+function testStablePositions() {
+  check(stableList([]).length === 0, "empty sequence");
+  check(stableList([-1, -1]).length === 0, "only new children");
+  check(String(stableList([0, 1, 2])) === "0,1,2", "in order");
+  check(String(stableList([2, 0, 1])) === "1,2", "one moved to the front");
+  check(String(stableList([-1, 3, -1, 1, 2])) === "3,4", "new children skipped");
+  check(stableList([3, 2, 1, 0]).length === 1, "reversed");
+
+  for (var round = 0; round < 2000; round++) {
+    var sequence = [];
+    var length = random(20);
+    for (var i = 0; i < length; i++) {
+      sequence.push(random(4) ? random(30) : -1);
+    }
+    var positions = stableList(sequence);
+    for (i = 1; i < positions.length; i++) {
+      check(sequence[positions[i - 1]] < sequence[positions[i]], "run not increasing in " + sequence);
+    }
+    for (i = 0; i < positions.length; i++) {
+      check(sequence[positions[i]] >= 0, "new child in run of " + sequence);
+    }
+    check(positions.length === longestRun(sequence), "run not the longest in " + sequence);
+  }
+}
+
+function matches(element, layout) {
+  if (element.children.length !== layout.length) {
+    return false;
+  }
+  return layout.every(function (description, i) {
+    var child = element.children[i];
+    if (child.type !== description.type || child.dead) {
+      return false;
+    }
+    for (var name in description.attributes || {}) {
+      if (child.attrs[name] !== String(description.attributes[name])) {
+        return false;
+      }
+    }
+    return matches(child, description.children || []);
+  });
+}
+
+function randomLayout(depth) {
+  var layout = [];
+  var count = random(8);
+  for (var i = 0; i < count; i++) {
+    var description = {type: ["text", "container", "inscroll"][random(3)], attributes: {value: "v" + random(4)}};
+    if (random(3)) {
+      description.key = random(10);
+    }
+    if (depth < 2 && random(2)) {
+      description.children = randomLayout(depth + 1);
+    }
+    layout.push(description);
+  }
+  return layout;
+}
+
+function testRandomLayouts() {
+  var root = new MockElement("activity");
+  resetOps();
+  for (var round = 0; round < 3000; round++) {
+    var layout = randomLayout(0);
+    reconcile(root, layout);
+    check(matches(root, layout), "layout " + round + " not matched");
+  }
+}
+
+function keyedList(order) {
+  return order.map(function (key) {
+    return {type: "text", key: key, attributes: {value: "item " + key}};
+  });
+}
+
+function testFewestMoves() {
+  var root = new MockElement("activity");
+  var order = [0, 1, 2, 3, 4, 5, 6, 7, 8, 9];
+  reconcile(root, keyedList(order));
+  var elements = root.children.slice();
+
+  resetOps();
+  reconcile(root, keyedList(order));
+  check(JSON.stringify(ops) === JSON.stringify({create: 0, remove: 0, move: 0, set: 0}), "unchanged layout touched the tree");
+
+  resetOps();
+  reconcile(root, keyedList(order.slice(1).concat([0])));
+  check(ops.move === 1 && ops.create === 0 && ops.remove === 0, "rotation took " + JSON.stringify(ops));
+  check(root.children.every(function (child) { return elements.indexOf(child) >= 0; }), "rotation replaced elements");
+
+  reconcile(root, keyedList(order));
+  resetOps();
+  reconcile(root, keyedList(order.slice().reverse()));
+  check(ops.move === 9, "reversal took " + ops.move + " moves");
+
+  // A new child is appended by createElement, so it takes a move into place as well as the swap
+  resetOps();
+  reconcile(root, keyedList([9, 8, 7, 6, 5, 4, 3, 11, 2, 0, 1]));
+  check(ops.create === 1 && ops.remove === 0 && ops.move === 2, "insert and swap took " + JSON.stringify(ops));
+  check(matches(root, keyedList([9, 8, 7, 6, 5, 4, 3, 11, 2, 0, 1])), "insert and swap not matched");
+}
+
+function testChildrenBeforeAttributes() {
+  var root = new MockElement("activity");
+  var items = [{type: "text"}, {type: "text"}, {type: "text"}];
+  reconcile(root, [{type: "inscroll", attributes: {index: 2}, children: items}]);
+  var menu = root.children[0];
+  check(menu.childrenWhenSet === 3, "menu index set before its children");
+
+  reconcile(root, [{type: "inscroll", attributes: {index: 3}, children: items.concat([{type: "text"}])}]);
+  check(menu.childrenWhenSet === 4, "new index set before the new child");
+}
+
+testStablePositions();
+testRandomLayouts();
+testFewestMoves();
+testChildrenBeforeAttributes();
+
+console.log(failures ? failures + " failures" : "ok");
+process.exitCode = failures ? 1 : 0;
@@ -0,0 +1,183 @@
+/*
+
+  Arduino.h - Host stand-in for the parts of the ESP32 core the headers
+  in include/ use, for env:native.
+
+  The clock only moves when a test calls hostAdvanceMs() or hostJumpMs(),
+  and the one task a test may create runs on a thread that sleeps against
+  that clock. hostAdvanceMs() steps from one wakeup of the task to the
+  next, as a real clock would, and returns once the task is idle again,
+  so callbacks see the exact time they were due.
+
+*/
+
+#ifndef Arduino_h
+#define Arduino_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+typedef void* SemaphoreHandle_t;
+typedef void* TaskHandle_t;
+typedef uint32_t TickType_t;
+typedef unsigned int UBaseType_t;
+typedef int BaseType_t;
+typedef void (*TaskFunction_t)(void* arg);
+
+#define pdTRUE 1
+#define pdFALSE 0
+#define portMAX_DELAY 0xFFFFFFFF
+#define portTICK_PERIOD_MS 1
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+
+// Never destroyed, so the task's thread can outlive main()
+struct HostClock {
+  std::mutex mutex;
+  std::condition_variable changed;
+  int64_t now = 0;                 // microseconds
+  std::thread::id task;
+  bool taskRunning = false;
+  bool waiting = false;            // the task is in ulTaskNotifyTake()
+  int64_t deadline = INT64_MAX;    // when that wait times out
+  bool notified = false;
+};
+
+inline HostClock& hostClock() {
+  static HostClock* clock = new HostClock;
+  return *clock;
+}
+
+inline bool hostTaskIdle(HostClock& clock) {
+  return !clock.taskRunning || (clock.waiting && !clock.notified && clock.now < clock.deadline);
+}
+
+// Wait for the task to run out of things to do
+inline void hostSettle() {
+  HostClock& clock = hostClock();
+  std::unique_lock<std::mutex> lock(clock.mutex);
+  clock.changed.wait(lock, [&] { return hostTaskIdle(clock); });
+}
+
+inline void hostSetTime(int64_t now) {
+  HostClock& clock = hostClock();
+  {
+    std::lock_guard<std::mutex> lock(clock.mutex);
+    clock.now = now;
+  }
+  clock.changed.notify_all();
+  hostSettle();
+}
+
+// Move the clock on, waking the task at each of its deadlines on the way
+inline void hostAdvanceMs(uint32_t ms) {
+  hostSettle();
+  HostClock& clock = hostClock();
+  int64_t target;
+  {
+    std::lock_guard<std::mutex> lock(clock.mutex);
+    target = clock.now + (int64_t)ms * 1000;
+  }
+  while (true) {
+    int64_t next;
+    {
+      std::lock_guard<std::mutex> lock(clock.mutex);
+      if (clock.now >= target) {
+        return;
+      }
+      next = clock.deadline < target ? clock.deadline : target;
+    }
+    hostSetTime(next);
+  }
+}
+
+// Move the clock on at once, as if the task had been held up
+inline void hostJumpMs(uint32_t ms) {
+  hostSettle();
+  hostSetTime(hostClock().now + (int64_t)ms * 1000);
+}
+
+inline int64_t esp_timer_get_time() {
+  HostClock& clock = hostClock();
+  std::lock_guard<std::mutex> lock(clock.mutex);
+  return clock.now;
+}
+
+inline unsigned long millis() {
+  return esp_timer_get_time() / 1000;
+}
+
+inline SemaphoreHandle_t xSemaphoreCreateMutex() {
+  return new std::mutex;
+}
+
+inline void vSemaphoreDelete(SemaphoreHandle_t semaphore) {
+  delete (std::mutex*)semaphore;
+}
+
+inline BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t wait) {
+  ((std::mutex*)semaphore)->lock();
+  return pdTRUE;
+}
+
+inline BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore) {
+  ((std::mutex*)semaphore)->unlock();
+  return pdTRUE;
+}
+
+inline BaseType_t xTaskCreatePinnedToCore(TaskFunction_t task, const char* name, uint32_t stack, void* arg,
+    UBaseType_t priority, TaskHandle_t* handle, BaseType_t core) {
+  HostClock& clock = hostClock();
+  {
+    std::lock_guard<std::mutex> lock(clock.mutex);
+    clock.taskRunning = true;
+  }
+  std::thread thread(task, arg);
+  {
+    std::lock_guard<std::mutex> lock(clock.mutex);
+    clock.task = thread.get_id();
+  }
+  thread.detach();
+  if (handle) {
+    *handle = &clock.task;
+  }
+  return pdTRUE;
+}
+
+inline TaskHandle_t xTaskGetCurrentTaskHandle() {
+  HostClock& clock = hostClock();
+  return std::this_thread::get_id() == clock.task ? &clock.task : nullptr;
+}
+
+inline BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+  HostClock& clock = hostClock();
+  {
+    std::lock_guard<std::mutex> lock(clock.mutex);
+    clock.notified = true;
+  }
+  clock.changed.notify_all();
+  return pdTRUE;
+}
+
+inline uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t wait) {
+  HostClock& clock = hostClock();
+  std::unique_lock<std::mutex> lock(clock.mutex);
+  clock.deadline = wait == portMAX_DELAY ? INT64_MAX : clock.now + (int64_t)wait * 1000;
+  clock.waiting = true;
+  clock.changed.notify_all();
+  clock.changed.wait(lock, [&] { return clock.notified || clock.now >= clock.deadline; });
+  uint32_t notified = clock.notified;
+  clock.notified = false;
+  clock.waiting = false;
+  clock.deadline = INT64_MAX;
+  return notified;
+}
+
+inline void vTaskDelay(TickType_t ticks) {
+  std::this_thread::sleep_for(std::chrono::milliseconds(ticks));  // only cancel() waiting out a callback
+}
+
+#endif
@@ -0,0 +1,25 @@
+/*
+
+  esp_heap_caps.h - Host stand-in for the ESP-IDF capability allocator, for env:native.
+
+*/
+
+#ifndef esp_heap_caps_h
+#define esp_heap_caps_h
+
+#include <stdlib.h>
+
+#define MALLOC_CAP_8BIT (1 << 2)
+#define MALLOC_CAP_SPIRAM (1 << 10)
+#define MALLOC_CAP_INTERNAL (1 << 11)
+
+// No PSRAM on the host, so a pool asking for it falls back to internal RAM as on a board without
+inline void* heap_caps_malloc(size_t size, unsigned caps) {
+  return (caps & MALLOC_CAP_SPIRAM) ? nullptr : malloc(size);
+}
+
+inline void heap_caps_free(void* pointer) {
+  free(pointer);
+}
+
+#endif
@@ -0,0 +1,97 @@
+/*
+
+  Container composition as children are removed, moved and resized.
+  Runs on the board: pio test -e esp32dev -f test_container
+
+*/
+
+#include <Arduino.h>
+#include <unity.h>
+
+// The firmware's own setup() and loop() make way for the test runner's
+#define setup controllerSetup
+#define loop controllerLoop
+#include "../../src/main.cpp"
+#undef setup
+#undef loop
+
+// Every dot lit, whatever its size
+class SolidElement: public window::Element {
+public:
+  bool getPixel(uint8_t x, uint8_t y) { return true; }
+  void render(window::RenderParameters params) {}
+  const char* elementType() { return "solid"; }
+  size_t objectSize() { return sizeof(*this); }
+  bool handleInput(window::InputEventType inputEventType) { return false; }
+};
+
+window::CommandBuffer* commands;
+window::Container* container;
+window::Element* left;
+window::Element* right;
+
+void place(window::Element* element, const char* x) {
+  commands->setAttribute(element, "x", x);
+  commands->setAttribute(element, "width", "5");
+  commands->setAttribute(element, "height", "7");
+}
+
+void compose() {
+  commands->publish();
+  commands->apply();
+  window::RenderParameters params = {16};
+  container->renderIfDirty(params);
+}
+
+void setUp() {
+  commands = new window::CommandBuffer;
+  container = new window::Container;
+  commands->root = container;
+  left = new SolidElement;
+  right = new SolidElement;
+  commands->createElement(container, left);
+  commands->createElement(container, right);
+  place(left, "0");
+  place(right, "10");
+  compose();
+}
+
+void tearDown() {
+  delete container;
+  delete commands;
+}
+
+void test_children_drawn() {
+  TEST_ASSERT_TRUE(container->getPixel(0, 0));
+  TEST_ASSERT_TRUE(container->getPixel(14, 6));
+  TEST_ASSERT_FALSE(container->getPixel(7, 3));
+}
+
+void test_removed_child_goes_dark() {
+  commands->removeElement(container, right);
+  compose();
+  for (uint8_t x = 10; x < 15; x ++) {
+    for (uint8_t y = 0; y < 7; y ++) {
+      TEST_ASSERT_FALSE(container->getPixel(x, y));
+    }
+  }
+  TEST_ASSERT_TRUE(container->getPixel(0, 0));
+}
+
+void test_moved_child_leaves_nothing() {
+  commands->setAttribute(right, "x", "20");
+  compose();
+  TEST_ASSERT_FALSE(container->getPixel(10, 0));
+  TEST_ASSERT_TRUE(container->getPixel(20, 0));
+}
+
+void setup() {
+  delay(2000);  // let the serial monitor attach
+  UNITY_BEGIN();
+  RUN_TEST(test_children_drawn);
+  RUN_TEST(test_removed_child_goes_dark);
+  RUN_TEST(test_moved_child_leaves_nothing);
+  UNITY_END();
+}
+
+void loop() {}
@@ -0,0 +1,139 @@
+/*
+
+  ElementMenu selection as children are removed and moved under it.
+  Runs on the board: pio test -e esp32dev -f test_element_menu
+
+*/
+
+#include <Arduino.h>
+#include <unity.h>
+
+// The firmware's own setup() and loop() make way for the test runner's
+#define setup controllerSetup
+#define loop controllerLoop
+#include "../../src/main.cpp"
+#undef setup
+#undef loop
+
+window::CommandBuffer* commands;
+window::ElementMenu* menu;
+
+void setUp() {
+  commands = new window::CommandBuffer;
+  menu = new window::ElementMenu;
+  commands->root = menu;
+  for (int i = 0; i < 4; i ++) {
+    commands->createElement(menu, new window::TextElement);
+  }
+  commands->publish();
+  commands->apply();
+}
+
+void tearDown() {
+  delete menu;
+  delete commands;
+}
+
+void renderMenu() {
+  window::RenderParameters params = {16};
+  menu->render(params);
+}
+
+void select(int index) {
+  commands->setAttribute(menu, "index", std::to_string(index).c_str());
+  commands->publish();
+  commands->apply();
+  renderMenu();
+}
+
+void test_remove_selected_tail() {
+  select(3);
+  TEST_ASSERT_EQUAL(3, menu->pos);
+  commands->removeElement(menu, menu->children[3]);
+  commands->removeElement(menu, menu->children[2]);
+  commands->publish();
+  commands->apply();
+  TEST_ASSERT_EQUAL(2, menu->children.size());
+  TEST_ASSERT_EQUAL(1, menu->pos);
+  renderMenu();
+  TEST_ASSERT_EQUAL(1, menu->pos);
+  TEST_ASSERT_EQUAL_STRING("1", menu->attributes["index"].value.c_str());
+}
+
+void test_remove_every_child() {
+  select(2);
+  while (!menu->children.empty()) {
+    commands->removeElement(menu, menu->children.back());
+    commands->publish();
+    commands->apply();
+    renderMenu();
+  }
+  TEST_ASSERT_EQUAL(0, menu->pos);
+  TEST_ASSERT_FALSE(menu->getPixel(0, 0));
+}
+
+void test_remove_before_selection() {
+  select(2);
+  window::Element* selected = menu->children[2];
+  commands->removeElement(menu, menu->children[0]);
+  commands->publish();
+  commands->apply();
+  TEST_ASSERT_EQUAL(1, menu->pos);
+  TEST_ASSERT_EQUAL_PTR(selected, menu->children[menu->pos]);
+  TEST_ASSERT_EQUAL_STRING("1", menu->attributes["index"].value.c_str());
+}
+
+void test_move_keeps_selection() {
+  select(1);
+  window::Element* selected = menu->children[1];
+  commands->moveElement(menu, selected, 3);
+  commands->moveElement(menu, menu->children[0], 3);
+  commands->publish();
+  commands->apply();
+  TEST_ASSERT_EQUAL(2, menu->pos);
+  TEST_ASSERT_EQUAL_PTR(selected, menu->children[menu->pos]);
+  TEST_ASSERT_EQUAL_STRING("2", menu->attributes["index"].value.c_str());
+}
+
+void test_insert_keeps_selection() {
+  select(2);
+  window::Element* selected = menu->children[2];
+  commands->createElement(menu, new window::TextElement);
+  commands->publish();
+  commands->apply();
+  renderMenu();
+  TEST_ASSERT_EQUAL(5, menu->children.size());
+  TEST_ASSERT_EQUAL(2, menu->pos);
+  TEST_ASSERT_EQUAL_PTR(selected, menu->children[menu->pos]);
+  TEST_ASSERT_EQUAL_STRING("2", menu->attributes["index"].value.c_str());
+}
+
+// As the reconciler builds a menu - items first, then the menu's own attributes
+void test_new_menu_with_index() {
+  window::ElementMenu* fresh = new window::ElementMenu;
+  for (int i = 0; i < 3; i ++) {
+    commands->createElement(fresh, new window::TextElement);
+  }
+  commands->setAttribute(fresh, "index", "2");
+  commands->publish();
+  commands->apply();
+  window::RenderParameters params = {16};
+  fresh->render(params);
+  TEST_ASSERT_EQUAL(2, fresh->pos);
+  TEST_ASSERT_EQUAL_STRING("2", fresh->attributes["index"].value.c_str());
+  delete fresh;
+}
+
+void setup() {
+  delay(2000);  // let the serial monitor attach
+  UNITY_BEGIN();
+  RUN_TEST(test_remove_selected_tail);
+  RUN_TEST(test_remove_every_child);
+  RUN_TEST(test_remove_before_selection);
+  RUN_TEST(test_move_keeps_selection);
+  RUN_TEST(test_insert_keeps_selection);
+  RUN_TEST(test_new_menu_with_index);
+  UNITY_END();
+}
+
+void loop() {}
@@ -0,0 +1,154 @@
+/*
+
+  transpose8 and orientFrame from the shared DisplayBackend, checked dot by
+  dot against rotating and mirroring the frame one pixel at a time.
+  Runs on the host: pio test -e native -f test_native_display_backend
+
+*/
+
+#include <unity.h>
+#include <stdlib.h>
+#include <vector>
+
+#include "DisplayBackend.h"
+
+typedef std::vector<std::vector<bool>> Pixels;  // [x][y]
+
+void setUp() {
+  srand(1);
+}
+
+void tearDown() {}
+
+Pixels pixelsOf(const LogicalFrame& frame) {
+  Pixels pixels(frame.width, std::vector<bool>(frame.height));
+  for (uint8_t x = 0; x < frame.width; x ++) {
+    for (uint8_t y = 0; y < frame.height; y ++) {
+      pixels[x][y] = frame.getPixel(x, y);
+    }
+  }
+  return pixels;
+}
+
+// A quarter turn clockwise - the top left corner ends up top right
+Pixels rotate(const Pixels& pixels) {
+  size_t width = pixels.size();
+  size_t height = pixels[0].size();
+  Pixels rotated(height, std::vector<bool>(width));
+  for (size_t x = 0; x < height; x ++) {
+    for (size_t y = 0; y < width; y ++) {
+      rotated[x][y] = pixels[y][height - 1 - x];
+    }
+  }
+  return rotated;
+}
+
+Pixels mirror(const Pixels& pixels) {
+  return Pixels(pixels.rbegin(), pixels.rend());
+}
+
+void randomFrame(LogicalFrame& frame) {
+  for (uint8_t x = 0; x < frame.width; x ++) {
+    for (uint8_t y = 0; y < frame.height; y ++) {
+      frame.setPixel(x, y, rand() & 1);
+    }
+  }
+}
+
+void checkOrientation(uint8_t width, uint8_t height, uint8_t rotation, bool mirrored) {
+  LogicalFrame logical(width, height);
+  randomFrame(logical);
+  Orientation orientation;
+  orientation.rotation = rotation;
+  orientation.mirror = mirrored;
+
+  Pixels expected = pixelsOf(logical);
+  for (uint8_t i = 0; i < rotation; i ++) {
+    expected = rotate(expected);
+  }
+  if (mirrored) {
+    expected = mirror(expected);
+  }
+
+  PackedFrame panel;
+  orientFrame(logical, orientation, panel);
+  TEST_ASSERT_EQUAL(expected.size(), panel.width);
+  TEST_ASSERT_EQUAL(expected[0].size(), panel.height);
+  for (uint8_t x = 0; x < panel.width; x ++) {
+    for (uint8_t y = 0; y < panel.height; y ++) {
+      TEST_ASSERT_EQUAL(expected[x][y], panel.getPixel(x, y));
+    }
+    TEST_ASSERT_EQUAL(0, panel.columns[x] >> panel.height);  // nothing below the last row
+  }
+}
+
+void test_reverse8() {
+  for (int b = 0; b < 256; b ++) {
+    uint8_t reversed = reverse8(b);
+    for (int bit = 0; bit < 8; bit ++) {
+      TEST_ASSERT_EQUAL((b >> bit) & 1, (reversed >> (7 - bit)) & 1);
+    }
+  }
+}
+
+void test_transpose8() {
+  for (int tile = 0; tile < 1000; tile ++) {
+    uint8_t in[8];
+    uint8_t out[8];
+    uint8_t back[8];
+    for (int i = 0; i < 8; i ++) {
+      in[i] = rand();
+    }
+    transpose8(in, out);
+    for (int i = 0; i < 8; i ++) {
+      for (int j = 0; j < 8; j ++) {
+        TEST_ASSERT_EQUAL((in[i] >> j) & 1, (out[j] >> i) & 1);
+      }
+    }
+    transpose8(out, back);
+    TEST_ASSERT_EQUAL(0, memcmp(in, back, 8));
+  }
+}
+
+void test_corner_rotated_clockwise() {
+  LogicalFrame logical(7, 40);  // a wall mounted on its side
+  logical.setPixel(0, 0, true);
+  Orientation orientation;
+  orientation.rotation = 1;
+  PackedFrame panel;
+  orientFrame(logical, orientation, panel);
+  TEST_ASSERT_EQUAL(40, panel.width);
+  TEST_ASSERT_EQUAL(7, panel.height);
+  TEST_ASSERT_TRUE(panel.getPixel(39, 0));
+  TEST_ASSERT_EQUAL(1, panel.columns[39]);
+}
+
+void test_unrotated() {
+  for (bool mirrored : {false, true}) {
+    for (uint8_t rotation : {0, 2}) {
+      checkOrientation(40, 7, rotation, mirrored);
+      checkOrientation(28, 8, rotation, mirrored);
+      checkOrientation(5, 3, rotation, mirrored);
+    }
+  }
+}
+
+void test_rotated() {
+  for (bool mirrored : {false, true}) {
+    for (uint8_t rotation : {1, 3}) {
+      checkOrientation(7, 40, rotation, mirrored);
+      checkOrientation(8, 28, rotation, mirrored);
+      checkOrientation(3, 5, rotation, mirrored);
+    }
+  }
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_reverse8);
+  RUN_TEST(test_transpose8);
+  RUN_TEST(test_corner_rotated_clockwise);
+  RUN_TEST(test_unrotated);
+  RUN_TEST(test_rotated);
+  return UNITY_END();
+}
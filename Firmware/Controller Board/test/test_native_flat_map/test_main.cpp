@@ -0,0 +1,111 @@
+/*
+
+  SmallVector and FlatMap, inline and spilled to the heap.
+  Runs on the host: pio test -e native -f test_native_flat_map
+
+*/
+
+#include <unity.h>
+#include <string>
+
+#include "SmallVector.h"
+#include "FlatMap.h"
+
+void setUp() {}
+void tearDown() {}
+
+void test_stays_inline() {
+  SmallVector<int, 4> items;
+  for (int i = 0; i < 4; i ++) {
+    items.push_back(i);
+  }
+  TEST_ASSERT_EQUAL(4, items.size());
+  TEST_ASSERT_EQUAL(0, items.heapBytes());
+}
+
+void test_spills_in_order() {
+  SmallVector<std::string, 2> items;
+  for (int i = 0; i < 5; i ++) {
+    items.push_back(std::to_string(i));
+  }
+  TEST_ASSERT_EQUAL(5, items.size());
+  TEST_ASSERT_TRUE(items.heapBytes() > 0);
+  for (int i = 0; i < 5; i ++) {
+    TEST_ASSERT_EQUAL_STRING(std::to_string(i).c_str(), items[i].c_str());
+  }
+}
+
+void test_push_own_item_while_growing() {
+  SmallVector<std::string, 2> items;
+  items.push_back("a long string, so it lives on the heap");
+  items.push_back("b");
+  items.push_back(items[0]);  // the storage it refers to moves
+  TEST_ASSERT_EQUAL(3, items.size());
+  TEST_ASSERT_EQUAL_STRING("a long string, so it lives on the heap", items[2].c_str());
+  TEST_ASSERT_EQUAL_STRING("a long string, so it lives on the heap", items[0].c_str());
+}
+
+void test_insert_and_erase() {
+  SmallVector<int, 2> items;
+  items.push_back(1);
+  items.push_back(3);
+  items.insert(items.begin() + 1, 2);
+  items.insert(items.begin(), 0);
+  TEST_ASSERT_EQUAL(4, items.size());
+  for (int i = 0; i < 4; i ++) {
+    TEST_ASSERT_EQUAL(i, items[i]);
+  }
+  items.erase(items.begin() + 1);
+  TEST_ASSERT_EQUAL(3, items.size());
+  TEST_ASSERT_EQUAL(0, items[0]);
+  TEST_ASSERT_EQUAL(2, items[1]);
+  TEST_ASSERT_EQUAL(3, items[2]);
+}
+
+void test_map_sorted() {
+  FlatMap<std::string, int, 2> map;
+  map["y"] = 1;
+  map["height"] = 2;
+  map["x"] = 3;
+  map["index"] = 4;
+  const char* keys[] = {"height", "index", "x", "y"};
+  int i = 0;
+  for (auto& item : map) {
+    TEST_ASSERT_EQUAL_STRING(keys[i ++], item.first.c_str());
+  }
+  TEST_ASSERT_EQUAL(4, map.size());
+}
+
+void test_map_lookup() {
+  FlatMap<std::string, int, 4> map;
+  map["value"] = 7;
+  TEST_ASSERT_EQUAL(1, map.count("value"));
+  TEST_ASSERT_EQUAL(0, map.count("width"));
+  TEST_ASSERT_TRUE(map.find("width") == map.end());
+  TEST_ASSERT_EQUAL(7, map.find("value")->second);
+  map["value"] = 8;  // existing key, no new entry
+  TEST_ASSERT_EQUAL(1, map.size());
+  TEST_ASSERT_EQUAL(8, map["value"]);
+}
+
+void test_map_erase() {
+  FlatMap<std::string, int, 4> map;
+  map["a"] = 1;
+  map["b"] = 2;
+  TEST_ASSERT_EQUAL(1, map.erase("a"));
+  TEST_ASSERT_EQUAL(0, map.erase("a"));
+  TEST_ASSERT_EQUAL(1, map.size());
+  TEST_ASSERT_EQUAL(2, map["b"]);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_stays_inline);
+  RUN_TEST(test_spills_in_order);
+  RUN_TEST(test_push_own_item_while_growing);
+  RUN_TEST(test_insert_and_erase);
+  RUN_TEST(test_map_sorted);
+  RUN_TEST(test_map_lookup);
+  RUN_TEST(test_map_erase);
+  return UNITY_END();
+}
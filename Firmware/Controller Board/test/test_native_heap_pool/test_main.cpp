@@ -0,0 +1,97 @@
+/*
+
+  HeapPool size classes, reuse, the cap and reallocation.
+  Runs on the host: pio test -e native -f test_native_heap_pool
+
+*/
+
+#include <unity.h>
+#include <stdint.h>
+
+#include "HeapPool.h"
+
+HeapPool* pool;
+
+void setUp() {
+  pool = new HeapPool(1024, true);
+}
+
+void tearDown() {
+  delete pool;
+}
+
+void test_size_classes() {
+  TEST_ASSERT_FALSE(pool->inPsram);
+  TEST_ASSERT_EQUAL(1024, pool->getCapacity());
+  TEST_ASSERT_NULL(pool->allocate(0));
+  pool->allocate(8);  // 16 with its header
+  TEST_ASSERT_EQUAL(16, pool->inUse);
+  pool->allocate(9);
+  TEST_ASSERT_EQUAL(16 + 32, pool->inUse);
+  pool->allocate(100);
+  TEST_ASSERT_EQUAL(16 + 32 + 128, pool->inUse);
+}
+
+void test_aligned_to_base() {
+  for (size_t size = 1; size < 100; size += 13) {
+    uint8_t* block = (uint8_t*)pool->allocate(size);
+    TEST_ASSERT_NOT_NULL(block);
+    TEST_ASSERT_EQUAL(0, (block - pool->base()) % 8);
+  }
+}
+
+void test_freed_block_reused() {
+  void* first = pool->allocate(20);
+  pool->allocate(20);
+  pool->release(first);
+  TEST_ASSERT_EQUAL(32, pool->inUse);
+  TEST_ASSERT_EQUAL_PTR(first, pool->allocate(24));  // same class
+  TEST_ASSERT_EQUAL(64, pool->inUse);
+  TEST_ASSERT_EQUAL(64, pool->peak);
+  pool->release(nullptr);
+}
+
+void test_cap() {
+  int blocks = 0;
+  while (pool->allocate(56)) {  // 64 byte blocks
+    blocks ++;
+  }
+  TEST_ASSERT_EQUAL(1024 / 64, blocks);
+  TEST_ASSERT_EQUAL(1, pool->failures);
+  TEST_ASSERT_NULL(pool->allocate(1 << 30));
+  TEST_ASSERT_EQUAL(2, pool->failures);
+  TEST_ASSERT_EQUAL(1024, pool->peak);
+}
+
+void test_reallocate() {
+  char* text = (char*)pool->allocate(10);
+  memcpy(text, "flip dots", 10);
+  TEST_ASSERT_EQUAL_PTR(text, pool->reallocate(text, 20));  // within a factor of two
+  char* moved = (char*)pool->reallocate(text, 200);
+  TEST_ASSERT_TRUE(moved != text);
+  TEST_ASSERT_EQUAL_STRING("flip dots", moved);
+  TEST_ASSERT_EQUAL(256, pool->inUse);
+  TEST_ASSERT_NULL(pool->reallocate(moved, 0));
+  TEST_ASSERT_EQUAL(0, pool->inUse);
+}
+
+void test_reallocate_at_cap() {
+  char* big = (char*)pool->allocate(500);  // 512
+  char* text = (char*)pool->allocate(200);  // 256
+  memcpy(text, "still here", 11);
+  TEST_ASSERT_NULL(pool->reallocate(text, 400));  // no room, the old block stays valid
+  TEST_ASSERT_EQUAL_STRING("still here", text);
+  pool->allocate(200);
+  TEST_ASSERT_EQUAL_PTR(big, pool->reallocate(big, 50));  // a shrink with no room stays put
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_size_classes);
+  RUN_TEST(test_aligned_to_base);
+  RUN_TEST(test_freed_block_reused);
+  RUN_TEST(test_cap);
+  RUN_TEST(test_reallocate);
+  RUN_TEST(test_reallocate_at_cap);
+  return UNITY_END();
+}
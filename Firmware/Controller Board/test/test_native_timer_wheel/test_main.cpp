@@ -0,0 +1,142 @@
+/*
+
+  TimerWheel expiry, periods, restarts and cancels against a fake clock.
+  Runs on the host: pio test -e native -f test_native_timer_wheel
+
+*/
+
+#include <Arduino.h>
+#include <unity.h>
+
+#include "TimerWheel.h"
+
+TimerWheel timers;
+
+// Counts calls, and remembers when the last one came
+struct Probe {
+  WheelTimer timer;
+  int calls = 0;
+  uint64_t calledAt = 0;
+  int cancelAfter = 0;  // cancels itself on this call, if not 0
+
+  Probe(): timer(fire, this) {}
+
+  static void fire(void* arg) {
+    Probe* probe = (Probe*)arg;
+    probe->calls ++;
+    probe->calledAt = timers.now();
+    if (probe->calls == probe->cancelAfter) {
+      timers.cancel(probe->timer);
+    }
+  }
+};
+
+Probe* probe;
+
+void setUp() {
+  probe = new Probe;
+}
+
+void tearDown() {
+  timers.cancel(probe->timer);
+  delete probe;
+}
+
+void test_one_shot() {
+  uint64_t start = timers.now();
+  timers.start(probe->timer, 10);
+  TEST_ASSERT_TRUE(timers.isPending(probe->timer));
+  hostAdvanceMs(9);
+  TEST_ASSERT_EQUAL(0, probe->calls);
+  hostAdvanceMs(1);
+  TEST_ASSERT_EQUAL(1, probe->calls);
+  TEST_ASSERT_EQUAL(start + 10, probe->calledAt);
+  TEST_ASSERT_FALSE(timers.isPending(probe->timer));
+  hostAdvanceMs(100);
+  TEST_ASSERT_EQUAL(1, probe->calls);
+}
+
+void test_periodic() {
+  uint64_t start = timers.now();
+  timers.start(probe->timer, 5, 5);
+  hostAdvanceMs(22);
+  TEST_ASSERT_EQUAL(4, probe->calls);
+  TEST_ASSERT_EQUAL(start + 20, probe->calledAt);
+  timers.cancel(probe->timer);
+  hostAdvanceMs(20);
+  TEST_ASSERT_EQUAL(4, probe->calls);
+}
+
+void test_cancel_before_due() {
+  timers.start(probe->timer, 10);
+  hostAdvanceMs(5);
+  timers.cancel(probe->timer);
+  TEST_ASSERT_FALSE(timers.isPending(probe->timer));
+  hostAdvanceMs(20);
+  TEST_ASSERT_EQUAL(0, probe->calls);
+}
+
+void test_restart_moves_expiry() {
+  uint64_t start = timers.now();
+  timers.start(probe->timer, 10);
+  hostAdvanceMs(5);
+  timers.start(probe->timer, 10);
+  hostAdvanceMs(10);
+  TEST_ASSERT_EQUAL(1, probe->calls);
+  TEST_ASSERT_EQUAL(start + 15, probe->calledAt);
+}
+
+void test_higher_levels() {
+  uint32_t delays[] = {63, 64, 65, 4095, 4096, 300000, 20000000};  // the last is beyond the wheel's reach
+  for (uint32_t delay : delays) {
+    Probe far;
+    uint64_t start = timers.now();
+    timers.start(far.timer, delay);
+    hostAdvanceMs(delay);
+    TEST_ASSERT_EQUAL(1, far.calls);
+    TEST_ASSERT_EQUAL(start + delay, far.calledAt);
+  }
+}
+
+void test_held_up_periodic_keeps_phase() {
+  uint64_t start = timers.now();
+  timers.start(probe->timer, 10, 10);
+  hostJumpMs(35);  // the worker catches up on the ticks it missed
+  TEST_ASSERT_EQUAL(3, probe->calls);
+  hostAdvanceMs(5);
+  TEST_ASSERT_EQUAL(4, probe->calls);
+  TEST_ASSERT_EQUAL(start + 40, probe->calledAt);
+}
+
+void test_start_after_idle() {
+  hostJumpMs(100000);  // nothing pending, the wheel stops counting
+  uint64_t start = timers.now();
+  timers.start(probe->timer, 10);
+  hostAdvanceMs(9);
+  TEST_ASSERT_EQUAL(0, probe->calls);
+  hostAdvanceMs(1);
+  TEST_ASSERT_EQUAL(1, probe->calls);
+  TEST_ASSERT_EQUAL(start + 10, probe->calledAt);
+}
+
+void test_cancel_from_callback() {
+  probe->cancelAfter = 2;
+  timers.start(probe->timer, 1, 1);
+  hostAdvanceMs(10);
+  TEST_ASSERT_EQUAL(2, probe->calls);
+  TEST_ASSERT_FALSE(timers.isPending(probe->timer));
+}
+
+int main() {
+  timers.begin(1, 0);
+  UNITY_BEGIN();
+  RUN_TEST(test_one_shot);
+  RUN_TEST(test_periodic);
+  RUN_TEST(test_cancel_before_due);
+  RUN_TEST(test_restart_moves_expiry);
+  RUN_TEST(test_higher_levels);
+  RUN_TEST(test_held_up_periodic_keeps_phase);
+  RUN_TEST(test_start_after_idle);
+  RUN_TEST(test_cancel_from_callback);
+  return UNITY_END();
+}
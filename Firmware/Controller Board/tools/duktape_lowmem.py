@@ -0,0 +1,96 @@
+#
+#  duktape_lowmem.py - prepares the ROM built-in Duktape sources for env:esp32dev_lowmem.
+#
+#  Runs before the build as a PlatformIO extra script. The sources are generated once
+#  from the Duktape release with configure.py --rom-support and lib/Duktape/flipdot_builtins.yaml,
+#  and again whenever the builtin file or duk_config.h changes. Set DUKTAPE_DIST to an unpacked
+#  duktape-2.7.0 release to build offline, otherwise the release is downloaded into .pio.
+#  configure.py runs under DUKTAPE_PYTHON, python2 if there is one, and needs PyYAML.
+#
+
+import hashlib
+import os
+import shutil
+import subprocess
+import sys
+import tarfile
+import urllib.request
+
+Import("env")
+
+DUKTAPE_VERSION = "2.7.0"
+DUKTAPE_URL = "https://github.com/svaarala/duktape/releases/download/v%s/duktape-%s.tar.xz" % (
+    DUKTAPE_VERSION, DUKTAPE_VERSION)
+
+project_dir = env.subst("$PROJECT_DIR")
+work_dir = os.path.join(project_dir, ".pio", "duktape_lowmem")
+out_dir = os.path.join(work_dir, "src")
+lib_dir = os.path.join(project_dir, "lib", "Duktape")
+builtin_file = os.path.join(lib_dir, "flipdot_builtins.yaml")
+config_file = os.path.join(lib_dir, "duk_config.h")
+
+
+def inputs_hash():
+    digest = hashlib.sha1(DUKTAPE_VERSION.encode())
+    for path in (builtin_file, config_file):
+        with open(path, "rb") as f:
+            digest.update(f.read())
+    return digest.hexdigest()
+
+
+def duktape_dist():
+    dist = os.environ.get("DUKTAPE_DIST")
+    if dist:
+        return dist
+    dist = os.path.join(work_dir, "duktape-%s" % DUKTAPE_VERSION)
+    if not os.path.isdir(dist):
+        archive = dist + ".tar.xz"
+        print("Downloading Duktape %s" % DUKTAPE_VERSION)
+        urllib.request.urlretrieve(DUKTAPE_URL, archive)
+        with tarfile.open(archive) as tar:
+            tar.extractall(work_dir)
+        os.remove(archive)
+    return dist
+
+
+def python_for_configure():
+    python = os.environ.get("DUKTAPE_PYTHON")
+    if python:
+        return python
+    return shutil.which("python2") or sys.executable
+
+
+def prepare():
+    stamp = os.path.join(out_dir, "flipdot.stamp")
+    wanted = inputs_hash()
+    if os.path.isfile(stamp):
+        with open(stamp) as f:
+            if f.read().strip() == wanted:
+                return
+
+    dist = duktape_dist()
+    generated = os.path.join(work_dir, "configured")
+    shutil.rmtree(generated, ignore_errors=True)
+    print("Preparing ROM built-in Duktape sources")
+    subprocess.check_call([
+        python_for_configure(), os.path.join(dist, "tools", "configure.py"),
+        "--output-directory", generated,
+        "--rom-support", "--rom-auto-lightfunc",
+        "--builtin-file", builtin_file,
+        "-DDUK_USE_ROM_OBJECTS", "-DDUK_USE_ROM_STRINGS", "-DDUK_USE_ROM_GLOBAL_INHERIT",
+    ])
+
+    shutil.rmtree(out_dir, ignore_errors=True)
+    os.makedirs(out_dir)
+    for name in ("duktape.c", "duktape.h", "duk_source_meta.json"):
+        shutil.copy(os.path.join(generated, name), out_dir)
+    shutil.copy(config_file, out_dir)  # ours, with the FLIPDOT_DUK_LOWMEM profile
+    with open(stamp, "w") as f:
+        f.write(wanted)
+
+
+prepare()
+
+# lib/Duktape is ignored in this env, the prepared copy takes its place
+env.Prepend(CPPPATH=[out_dir])
+env.BuildSources(os.path.join("$BUILD_DIR", "duktape_lowmem"), out_dir, "+<duktape.c>")
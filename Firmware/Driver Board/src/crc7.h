@@ -0,0 +1,27 @@
+/*
+
+  crc7.h - CRC-7 over link mode bursts, x^7 + x^3 + 1 with an initial 0.
+
+  The same CRC as SD card commands. The controller computes it over the
+  length and payload of each register 14 burst, and the module drops any
+  burst it doesn't match.
+
+*/
+
+#ifndef crc7_h
+#define crc7_h
+
+#include <stdint.h>
+
+inline uint8_t crc7(uint8_t crc, uint8_t val) {  // CRC-7, x^7 + x^3 + 1
+  for (uint8_t bit = 0; bit < 8; bit++) {
+    crc <<= 1;
+    if ((val ^ crc) & 0x80) {
+      crc ^= 0x09;
+    }
+    val <<= 1;
+  }
+  return crc & 0b01111111;
+}
+
+#endif
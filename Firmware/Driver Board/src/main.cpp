@@ -1,5 +1,6 @@
 #include <Arduino.h>
 #include <SPI.h>
+#include "crc7.h"
 
 #define MODULE_WIDTH 5
 #define MODULE_HEIGHT 7
@@ -17,6 +18,23 @@
 
 #define DUTCY_CYCLE_RATIO 100
 
+// Telemetry return path
+#define TELEMETRY_LINK_NONE 0         // write-only, telemetry requests are ignored
+#define TELEMETRY_LINK_HALF_DUPLEX 1  // reply on the shared data line - TX and RX joined, open drain
+#define TELEMETRY_LINK_RETURN_LINE 2  // reply on a return line shared by the chain - TX open drain, wired-OR
+#ifndef TELEMETRY_LINK
+  #define TELEMETRY_LINK TELEMETRY_LINK_RETURN_LINE
+#endif
+
+// Link mode, see registers 13 and 14
+#define LINK_RATE_COUNT 3
+#define LINK_BURST_MAX 8          // start register and up to 7 values
+#define LINK_SILENCE_MS 2000      // fall back to 115200 after this long without a good burst
+#define LINK_ERROR_LIMIT 8        // or after this many bad bursts in a row
+#define LINK_SWITCH_QUIET_US 500  // switch rate once the line has been idle this long, under the controller's 2 ms wait
+
+#define TELEMETRY_REPLY_BYTES 38   // header, 36 value septets, checksum
+
 // Configurables
 uint8_t address = 0;
 bool vertical = true;
@@ -39,8 +57,27 @@ int dead_time = 10;
 int saturationTime = 500;   //Flip time spent passing current through coils - 1us resolution
 
 // Loop indexing
-bool counterRunning = false;
-int index = 0;
+volatile bool counterRunning = false;
+volatile int index = 0;
+
+// Pulse engine
+// The shift registers hold two words: the one driving the coils and the one
+// being shifted in behind it. The next word can't go in while the coil is
+// energised - there is no output enable, so de-energising means clearing the
+// shift stage and latching the zeros. It is preloaded during the dead time
+// instead: the underflow ISR latches the zeros, queues the first two bytes
+// and waits out two byte times (~3.2 us) to queue the last two, which finish
+// shifting after it returns. Margin, from the host simulator: the word is in
+// place at least 6.3 us before the compare ISR latches it, and the underflow
+// ISR's ~12 us can hold the compare ISR back by up to ~2.7 us, shortening
+// that pulse by about 0.5%. A word that isn't ready skips its slot and is
+// counted in preloadUnderruns - none in the simulator at either link rate.
+volatile bool preloadBusy = false;
+volatile uint16_t preloadUnderruns = 0;  // slots skipped because the word was still shifting
+
+// ISR latency from timer event to RCLK edge - 100ns resolution
+volatile uint16_t isrLatency = 0;
+volatile uint16_t isrLatencyMax = 0;
 
 uint8_t display_config = 0;
 
@@ -50,18 +87,75 @@ bool moduleActive = false;
 bool frameBufferWrite = true;
 bool fullRedraw = true;
 
-void shift32(uint32_t registerFrame) {  // Shift 32 bits to registers in 8 bit chunks
-  uint8_t shift = 32U; 
-  do {
-      shift -= 8U;
-      SPI.transfer((uint8_t)(registerFrame >> shift));
-  } while ( shift ) ;
+// Telemetry counters - all wrap, the controller works with differences
+uint16_t sweepCount = 0;
+uint32_t pulsesIssued = 0;
+uint16_t framesDropped = 0;     // frames overwritten before a sweep picked them up
+uint16_t rxOverruns = 0;        // loop passes that found received bytes lost, by the core's overflow flags
+uint8_t framesPending = 0;      // complete frames written since the last sweep started
+uint16_t flipCounts[35] = {0};  // per pixel, saturating
+bool telemetryRequested = false;
+
+// Reply queued by queue_telemetry() and fed to the TX ring as it drains, so loop() never waits on it
+uint8_t telemetryReply[TELEMETRY_REPLY_BYTES];
+uint8_t telemetryLength = 0;
+uint8_t telemetrySent = 0;
+
+// Static RAM, counted from the simulator build with AVR type sizes: 364 of the ATtiny424's 512 bytes for
+// these globals, plus megaTinyCore's serial rings (32 RX, 16 TX on 512 byte parts) and timekeeping -
+// about 85 bytes of stack remain. Constant tables stay in the memory-mapped flash.
+
+// Link mode - 1 Mbaud would fit the USART, but overflows the receive ring while genStates runs
+const unsigned long linkRates[LINK_RATE_COUNT] = {115200, 250000, 500000};
+uint8_t link_rate = 0;
+int8_t pendingLinkRate = -1;    // register 13 value waiting for the line to go quiet
+unsigned long lastRxAt = 0;     // micros() of the last byte read
+uint16_t crcErrors = 0;         // bursts dropped for a bad length or CRC, or cut short
+uint8_t crcErrorRun = 0;
+unsigned long lastGoodBurst = 0;
+uint8_t burstBuffer[LINK_BURST_MAX];
+int8_t burstLength = -1;        // -1 until the length septet arrives
+uint8_t burstReceived = 0;
+
+void preload32(uint32_t registerFrame) {  // Shift 32 bits to registers, returns once the last byte is buffered
+  SPI0.INTFLAGS = SPI_TXCIF_bm;
+  SPI0.DATA = (uint8_t)(registerFrame >> 24);  // straight into the shifter
+  SPI0.DATA = (uint8_t)(registerFrame >> 16);  // into the transmit buffer
+  while (!(SPI0.INTFLAGS & SPI_DREIF_bm));
+  SPI0.DATA = (uint8_t)(registerFrame >> 8);
+  while (!(SPI0.INTFLAGS & SPI_DREIF_bm));
+  SPI0.DATA = (uint8_t)registerFrame;
+  preloadBusy = true;
 }
 
-  void clockRegisters() {  // Cycle RCLK pin
-    digitalWrite(RCLK, HIGH);
-    digitalWrite(RCLK, LOW);
+inline bool preloadDone() {  // Transmit complete - the whole word is in the shift stage
+  if (preloadBusy && (SPI0.INTFLAGS & SPI_TXCIF_bm)) {
+    preloadBusy = false;
   }
+  return !preloadBusy;
+}
+
+inline void clockRegisters() {  // Cycle RCLK pin
+  digitalWriteFast(RCLK, HIGH);
+  digitalWriteFast(RCLK, LOW);
+}
+
+inline void clearShiftStage() {  // Zero the shift stage without touching the outputs
+  digitalWriteFast(SRCLR, LOW);
+  digitalWriteFast(SRCLR, HIGH);
+}
+
+inline void recordLatency(uint16_t ticks) {
+  isrLatency = ticks;
+  if (ticks > isrLatencyMax) {
+    isrLatencyMax = ticks;
+  }
+}
+
+void setPulseTiming() {  // Buffered - takes effect at the next slot boundary
+  TCA0.SINGLE.PERBUF = (saturationTime + dead_time) * 10; //count from top
+  TCA0.SINGLE.CMP0BUF = saturationTime * 10; //compare at midpoint
+}
 
 uint32_t gen_register_state(uint8_t segmentX, uint8_t segmentY, bool segmentValue) {
   uint32_t register_state = 0;
@@ -82,19 +176,140 @@ uint32_t gen_register_state(uint8_t segmentX, uint8_t segmentY, bool segmentValu
   return register_state;
 }
 
+#define SCAN_ORDER_COLUMN_MAJOR 0
+#define SCAN_ORDER_ROW_MAJOR 1
+#define SCAN_ORDER_REVERSED 2
+#define SCAN_ORDER_SERPENTINE 3
+#define SCAN_ORDER_SCROLL 4
+uint8_t scan_order = SCAN_ORDER_COLUMN_MAJOR;
+
+#define SCROLL_DIRECTION_LEFT 0
+#define SCROLL_DIRECTION_RIGHT 1
+#define SCROLL_DIRECTION_UP 2
+#define SCROLL_DIRECTION_DOWN 3
+uint8_t scroll_direction = SCROLL_DIRECTION_LEFT;
+
+uint8_t slotOrder[35] = {0};  // pixel pulsed in each slot - sweep in the high nibble, step in the low nibble
+
+void genScanOrder() {  // Rebuild the slot order, only needed when register 10 changes
+  bool rowMajor = (scan_order == SCAN_ORDER_ROW_MAJOR);
+  bool columnsReversed = (scan_order == SCAN_ORDER_REVERSED);
+  bool rowsReversed = (scan_order == SCAN_ORDER_REVERSED);
+  bool serpentine = (scan_order == SCAN_ORDER_SERPENTINE);
+
+  if (scan_order == SCAN_ORDER_SCROLL) {  // wipe travels with the content
+    rowMajor = (scroll_direction == SCROLL_DIRECTION_UP || scroll_direction == SCROLL_DIRECTION_DOWN);
+    columnsReversed = (scroll_direction == SCROLL_DIRECTION_LEFT);
+    rowsReversed = (scroll_direction == SCROLL_DIRECTION_DOWN);
+  }
+
+  uint8_t outerCount = rowMajor ? 7 : 5;
+  uint8_t innerCount = rowMajor ? 5 : 7;
+  uint8_t slot = 0;
+  for (uint8_t outer = 0; outer < outerCount; outer++) {
+    for (uint8_t inner = 0; inner < innerCount; inner++) {
+      uint8_t sweep = rowMajor ? inner : outer;
+      uint8_t step = rowMajor ? outer : inner;
+      if (serpentine && (outer & 1)) {
+        step = 6 - step;
+      }
+      if (columnsReversed) {
+        sweep = 4 - sweep;
+      }
+      if (rowsReversed) {
+        step = 6 - step;
+      }
+      slotOrder[slot] = (sweep << 4) | step;
+      slot ++;
+    }
+  }
+}
+
 void genStates() {
-  for (int sweep = 0; sweep < 5; sweep++) {
-    for (int step = 0; step < 7; step++) {
-      bool currentValue = bitRead(stateBuffer[sweep], step);
-      bool segmentValue = bitRead(frameBuffer[sweep], step);
-      if (currentValue != segmentValue || fullRedraw) {
-        registerFrames[sweep * 7 + step] = gen_register_state(sweep, step, segmentValue);
-        bitWrite(stateBuffer[sweep], step, segmentValue);
-      } else {
-        registerFrames[sweep * 7 + step] = 0;
+  uint8_t pulses = 0;
+  for (int slot = 0; slot < 35; slot++) {
+    uint8_t sweep = slotOrder[slot] >> 4;
+    uint8_t step = slotOrder[slot] & 0x0F;
+    bool currentValue = bitRead(stateBuffer[sweep], step);
+    bool segmentValue = bitRead(frameBuffer[sweep], step);
+    if (currentValue != segmentValue || fullRedraw) {
+      registerFrames[slot] = gen_register_state(sweep, step, segmentValue);
+      bitWrite(stateBuffer[sweep], step, segmentValue);
+      pulses ++;
+      if (flipCounts[sweep * 7 + step] < 0xFFFF) {
+        flipCounts[sweep * 7 + step] ++;
       }
+    } else {
+      registerFrames[slot] = 0;
     }
   }
+  pulsesIssued += pulses;
+  sweepCount ++;
+  if (framesPending > 1) {
+    framesDropped += framesPending - 1;
+  }
+  framesPending = 0;
+}
+
+void queue_septets(uint32_t value, uint8_t count, uint8_t &checksum) {  // LSB first, 7 bits per byte
+  while (count--) {
+    uint8_t septet = value & 0b01111111;
+    telemetryReply[telemetryLength++] = septet;
+    checksum += septet;
+    value >>= 7;
+  }
+}
+
+void queue_telemetry() {
+  uint16_t latency;
+  uint16_t underruns;
+  noInterrupts();
+  latency = isrLatencyMax;
+  underruns = preloadUnderruns;
+  interrupts();
+
+  uint32_t flipTotal = 0;
+  uint16_t flipMax = 0;
+  uint8_t flipMaxDot = 0;
+  for (uint8_t dot = 0; dot < 35; dot++) {
+    flipTotal += flipCounts[dot];
+    if (flipCounts[dot] > flipMax) {
+      flipMax = flipCounts[dot];
+      flipMaxDot = dot;
+    }
+  }
+
+  uint8_t checksum = 0;
+  telemetryLength = 0;
+  telemetrySent = 0;
+  telemetryReply[telemetryLength++] = 0b10001100 | (address << 4);
+  queue_septets(sweepCount, 3, checksum);
+  queue_septets(pulsesIssued, 5, checksum);
+  queue_septets(framesDropped, 3, checksum);
+  queue_septets(rxOverruns, 3, checksum);
+  queue_septets(saturationTime, 3, checksum);
+  queue_septets(latency, 3, checksum);
+  queue_septets(underruns, 3, checksum);
+  queue_septets(flipTotal, 5, checksum);
+  queue_septets(flipMax, 3, checksum);
+  queue_septets(flipMaxDot, 1, checksum);
+  queue_septets(crcErrors, 3, checksum);
+  queue_septets(link_rate, 1, checksum);
+  telemetryReply[telemetryLength++] = checksum & 0b01111111;
+}
+
+void send_telemetry() {  // as much of the queued reply as the TX ring takes without blocking
+  while (telemetrySent < telemetryLength && Serial.availableForWrite() > 0) {
+    Serial.write(telemetryReply[telemetrySent++]);
+  }
+}
+
+void count_rx_overruns() {  // the core flags a full ring or a hardware overrun, and clears the flags on read
+#if defined(SERIAL_OVERFLOW_RING) && defined(SERIAL_OVERFLOW_HARDWARE)
+  if (Serial.getStatus() & (SERIAL_OVERFLOW_RING | SERIAL_OVERFLOW_HARDWARE)) {
+    rxOverruns ++;
+  }
+#endif  // older cores don't report it, and the count stays 0
 }
 
 #define RASTER_MODE_HORIZONTAL false
@@ -113,6 +328,9 @@ bool horizontal_direction = HORIZONTAL_DIRECTION_LSB_LEFT;
 #define VERTICAL_DIRECTION_MSB_BOTTOM true
 bool vertical_direction = VERTICAL_DIRECTION_LSB_BOTTOM;
 
+// Vertical raster, LSB left, LSB bottom - columns arrive exactly as the framebuffer holds them
+bool native_raster = false;
+
 void increment_direction (uint8_t &val, bool direction) {
   if (direction) {
     val ++;
@@ -130,6 +348,13 @@ bool continue_iterate (uint8_t current, uint8_t target, bool direction) {
 }
 
 void handle_register_write(uint8_t reg, uint8_t val) {
+  if (native_raster) {
+    if (reg < 5) {
+      frameBuffer[reg] = val & 0b01111111;
+    }
+    return;
+  }
+
   uint8_t normalised_scan = 0; // LSB justified, LSB bottom/left pixel data
 
   uint8_t data_start_bit;
@@ -192,6 +417,133 @@ void handle_register_write(uint8_t reg, uint8_t val) {
 }
 
 
+void begin_serial() {
+#if TELEMETRY_LINK == TELEMETRY_LINK_HALF_DUPLEX
+  Serial.begin(linkRates[link_rate], SERIAL_8N1 | SERIAL_HALF_DUPLEX);
+#elif TELEMETRY_LINK == TELEMETRY_LINK_RETURN_LINE
+  Serial.begin(linkRates[link_rate], SERIAL_8N1 | SERIAL_OPENDRAIN);
+#else
+  Serial.begin(linkRates[link_rate]);
+#endif
+}
+
+void set_link_rate(uint8_t rate) {
+  while (telemetrySent < telemetryLength) {  // finish any telemetry reply at the old rate
+    Serial.write(telemetryReply[telemetrySent++]);
+  }
+  Serial.flush();
+  link_rate = rate;
+  pendingLinkRate = -1;
+  begin_serial();
+  lastGoodBurst = millis();
+  crcErrorRun = 0;
+}
+
+void write_register(uint8_t reg, uint8_t val) {
+  if (reg <= 6) {
+    handle_register_write(reg, val);
+    if (reg == ((raster_mode == RASTER_MODE_VERTICAL) ? 4 : 6) && framesPending < 0xFF) {
+      framesPending ++;
+    }
+  }
+  if (reg == 8) {
+    if(bitRead(val, 0)) {
+      raster_mode = RASTER_MODE_VERTICAL;
+    }
+    else {
+      raster_mode = RASTER_MODE_HORIZONTAL;
+    }
+    if(bitRead(val, 1)) {
+      data_justification = DATA_JUSTIFICATION_MSB;
+    }
+    else {
+      data_justification = DATA_JUSTIFICATION_LSB;
+    }
+    if(bitRead(val, 2)) {
+      horizontal_direction = HORIZONTAL_DIRECTION_MSB_LEFT;
+    }
+    else {
+      horizontal_direction = HORIZONTAL_DIRECTION_LSB_LEFT;
+    }
+    if(bitRead(val, 3)) {
+      vertical_direction = VERTICAL_DIRECTION_MSB_BOTTOM;
+    }
+    else {
+      vertical_direction = VERTICAL_DIRECTION_LSB_BOTTOM;
+    }
+    native_raster = (raster_mode == RASTER_MODE_VERTICAL && horizontal_direction == HORIZONTAL_DIRECTION_LSB_LEFT
+      && vertical_direction == VERTICAL_DIRECTION_LSB_BOTTOM);
+  }
+  if (reg == 9 ) {
+    int us_per_flip = (1000000/DUTCY_CYCLE_RATIO)/val;
+    us_per_flip -= 2*dead_time;
+    us_per_flip = constrain(us_per_flip, 1, 5000);
+    saturationTime = us_per_flip;
+    setPulseTiming();
+  }
+  if (reg == 10) {
+    uint8_t new_scan_order = val & 0b00000111;
+    uint8_t new_scroll_direction = (val & 0b00011000) >> 3;
+    if (new_scan_order != scan_order || new_scroll_direction != scroll_direction) {
+      scan_order = new_scan_order;
+      scroll_direction = new_scroll_direction;
+      genScanOrder();
+    }
+  }
+  if (reg == 13) {
+    if (val < LINK_RATE_COUNT) {
+      pendingLinkRate = (val != link_rate) ? val : -1;
+    }
+  }
+}
+
+void burst_error() {
+  crcErrors ++;
+  if (crcErrorRun < 0xFF) {
+    crcErrorRun ++;
+  }
+  burstLength = -1;
+  moduleActive = false;
+}
+
+void receive_burst(uint8_t val) {  // Register 14: length, start register and values, CRC-7
+  if (burstLength < 0) {
+    if (val == 0 || val > LINK_BURST_MAX) {
+      burst_error();
+      return;
+    }
+    burstLength = val;
+    burstReceived = 0;
+    return;
+  }
+  if (burstReceived < burstLength) {
+    burstBuffer[burstReceived] = val;
+    burstReceived ++;
+    return;
+  }
+
+  uint8_t crc = crc7(0, burstLength);
+  for (uint8_t i = 0; i < burstLength; i++) {
+    crc = crc7(crc, burstBuffer[i]);
+  }
+  if (crc != val) {
+    burst_error();
+    return;
+  }
+  lastGoodBurst = millis();
+  crcErrorRun = 0;
+  uint8_t reg = burstBuffer[0];
+  for (uint8_t i = 1; i < burstLength; i++) {
+    write_register(reg, burstBuffer[i]);
+    if (reg <= 6) {
+      reg = (reg + 1) % 7;
+    }
+  }
+  burstLength = -1;
+  moduleActive = false;  // one burst per selection
+}
+
+
 void setup() {
   _PROTECTED_WRITE(CLKCTRL_MCLKCTRLB, CLKCTRL_PEN_bm);  // Set 10 MHz clock
 
@@ -204,9 +556,20 @@ void setup() {
 
   address = digitalRead(ADDR_0) | digitalRead(ADDR_1) << 1 | digitalRead(ADDR_2) << 2;
 
+  genScanOrder();
+
   digitalWrite(SRCLR, HIGH);
+  clearShiftStage();
+  clockRegisters();
+
   SPI.begin();
-  Serial.begin(115200);
+  // Drive SPI0 directly: buffered master at CLK/2, so a 32 bit preload takes ~6.4us and fits in dead_time, see Pulse engine
+  // Polled rather than interrupt driven - an ISR per byte costs more than the byte takes to shift
+  SPI0.CTRLA = SPI_MASTER_bm | SPI_CLK2X_bm | SPI_PRESC_DIV4_gc | SPI_ENABLE_bm;
+  SPI0.CTRLB = SPI_BUFEN_bm | SPI_SSD_bm | SPI_MODE_0_gc;
+  SPI0.INTCTRL = 0;
+
+  begin_serial();
 
   takeOverTCA0();
   //TCA0.SINGLE.CTRLB = (TCA_SINGLE_WGMODE_NORMAL_gc); //Normal mode counter - default
@@ -247,15 +610,67 @@ void loop() {
   // - Bit 3: Vertical direction
   //   - 0: LSB represents bottom pixel
   //   - 1: MSB represents bottom pixel
+  // - Value 1 is the native layout and is copied straight into the framebuffer
 
   // Register 9: Display framerate - sets time current is developed per pixel
   //                                                          Higer framerate means lower time and requires higher supply voltage
   //                                                          Duty cycle per pixel is fixed at 1%
   //                                                          Limited to 5 ms
 
+  // Register 10: Scan order - order pixels are pulsed in within a sweep, defaults to 0:
+  // - Bits 0-2: Order
+  //   - 0: column-major - columns left to right, bottom to top within a column
+  //   - 1: row-major - rows bottom to top, left to right within a row
+  //   - 2: reversed column-major - columns right to left, top to bottom within a column
+  //   - 3: serpentine - column-major, alternate columns run top to bottom
+  //   - 4: scroll aligned - wipe travels in the declared scroll direction
+  // - Bits 3-4: Declared scroll direction, used by order 4
+  //   - 0: left
+  //   - 1: right
+  //   - 2: up
+  //   - 3: down
+
+  // Register 11: Telemetry request - on selection the module replies, no value
+  // Register 12: Telemetry reply - sent by modules, ignored on receipt:
+  //   0b1AAA1100 followed by 7-bit septets, multi-septet values LSB first
+  //   - sweep count (3)
+  //   - pulses issued (5)
+  //   - frames dropped before being swept (3)
+  //   - loop passes that found received bytes lost (3)
+  //   - saturation time in us (3)
+  //   - max ISR latency in 100ns ticks (3)
+  //   - preload underruns (3)
+  //   - total pixel flips (5)
+  //   - flips of the most flipped pixel (3)
+  //   - most flipped pixel, column * 7 + row (1)
+  //   - bursts dropped for a bad length or CRC, or cut short (3)
+  //   - link rate, as register 13 (1)
+  //   - checksum - sum of the previous septets (1)
+
+  // Register 13: Link rate - switches this module's UART once the line has been quiet for LINK_SWITCH_QUIET_US
+  // after the value, so the writes to the rest of the chain still arrive at the old rate. Defaults to 0:
+  //   - 0: 115200
+  //   - 1: 250000
+  //   - 2: 500000
+  // Above 115200 plain writes are ignored and registers can only be written by bursts. With no good burst
+  // for LINK_SILENCE_MS, or LINK_ERROR_LIMIT bad bursts in a row, the module falls back to 115200.
+
+  // Register 14: Burst - a framed, checksummed write, one per selection:
+  //   - length N of the following payload, 1 to LINK_BURST_MAX
+  //   - start register
+  //   - N - 1 values, auto-incrementing through registers 0 - 6 as plain writes do
+  //   - CRC-7 (x^7 + x^3 + 1, initial 0) over the length and payload
+  // A burst with a bad length or CRC, or cut short by the next header byte, is dropped whole and counted.
+
+  count_rx_overruns();
+
   while (Serial.available()) {
     incomingByte = Serial.read();
+    lastRxAt = micros();
     if (bitRead(incomingByte, 7)) {
+      if (moduleActive && selectedRegister == 14) {
+        burst_error();  // still open, bytes were lost - most likely to an RX overrun
+      }
       if ((incomingByte & 0b01110000) >> 4 == address) {
 
         moduleActive = true;
@@ -265,86 +680,88 @@ void loop() {
           fullRedraw = true;
           moduleActive = false;
         }
+        if (selectedRegister == 11) {
+          telemetryRequested = (TELEMETRY_LINK != TELEMETRY_LINK_NONE);
+          moduleActive = false;
+        }
+        if (selectedRegister == 14) {
+          burstLength = -1;
+        }
       }
       else {
         moduleActive = false;
       }
     }
     else if (moduleActive) {
-      if (selectedRegister <= 6) {
-        handle_register_write(selectedRegister, incomingByte);
-        selectedRegister ++;
-        if (selectedRegister > 6) {
-          selectedRegister = 0;
-        }
+      if (selectedRegister == 14) {
+        receive_burst(incomingByte);
       }
-      if (selectedRegister == 8) {
-        if(bitRead(incomingByte, 0)) {
-          raster_mode = RASTER_MODE_VERTICAL;
-        }
-        else {
-          raster_mode = RASTER_MODE_HORIZONTAL;
+      else if (link_rate == 0) {
+        write_register(selectedRegister, incomingByte);
+        if (selectedRegister <= 6) {
+          selectedRegister ++;
+          if (selectedRegister > 6) {
+            selectedRegister = 0;
+          }
         }
-        if(bitRead(incomingByte, 1)) {
-          data_justification = DATA_JUSTIFICATION_MSB;
-        }
-        else {
-          data_justification = DATA_JUSTIFICATION_LSB;
-        }
-        if(bitRead(incomingByte, 2)) {
-          horizontal_direction = HORIZONTAL_DIRECTION_MSB_LEFT;
-        }
-        else {
-          horizontal_direction = HORIZONTAL_DIRECTION_LSB_LEFT;
-        }
-        if(bitRead(incomingByte, 3)) {
-          vertical_direction = VERTICAL_DIRECTION_MSB_BOTTOM;
-        }
-        else {
-          vertical_direction = VERTICAL_DIRECTION_LSB_BOTTOM;
-        }
-      }
-      if (selectedRegister == 9 ) {
-        int us_per_flip = (1000000/DUTCY_CYCLE_RATIO)/incomingByte;
-        us_per_flip -= 2*dead_time;
-        us_per_flip = constrain(us_per_flip, 1, 5000);
-        saturationTime = us_per_flip;
-        TCA0.SINGLE.PER = (saturationTime + dead_time) * 10; //count from top
-        TCA0.SINGLE.CMP0 = saturationTime * 10; //compare at midpoint
       }
     }
   }
 
+  if (pendingLinkRate >= 0 && micros() - lastRxAt >= LINK_SWITCH_QUIET_US) {
+    set_link_rate(pendingLinkRate);
+  }
+  else if (link_rate && (millis() - lastGoodBurst > LINK_SILENCE_MS || crcErrorRun >= LINK_ERROR_LIMIT)) {
+    set_link_rate(0);
+  }
+
+  if (telemetryRequested && telemetrySent == telemetryLength) {  // a request during a reply waits for it
+    telemetryRequested = false;
+    queue_telemetry();
+  }
+  send_telemetry();
+
   if (!counterRunning){
     genStates();
     fullRedraw = false;
-    TCA0.SINGLE.CNT = (saturationTime  + dead_time)*10;
-    counterRunning = true;
     index = 0;
+    if (registerFrames[0]) {
+      preload32(registerFrames[0]);
+    }
+    TCA0.SINGLE.CNT = TCA0.SINGLE.PER;
+    counterRunning = true;
     TCA0.SINGLE.CTRLA = TCA_SINGLE_ENABLE_bm;
   }
 }
 
 
-ISR(TCA0_OVF_vect) {    // on overflow, shift out 0 and enter recovery time
+ISR(TCA0_OVF_vect) {    // on underflow, de-energise and preload the next pixel during the recovery time
+  if (preloadDone()) {
+    clearShiftStage();
+    clockRegisters();
+    recordLatency(TCA0.SINGLE.PER - TCA0.SINGLE.CNT);
+    if (index < 35 && registerFrames[index]) {  // shift stage is already clear for unchanged pixels
+      preload32(registerFrames[index]);
+    }
+  } // else the last energise was skipped, outputs are still off and the pending word is kept
   if (index >= DUTCY_CYCLE_RATIO) {
     TCA0.SINGLE.CTRLA = 0;
     counterRunning = false;
   }
-  shift32(0x00); 
-  clockRegisters();
   TCA0.SINGLE.INTFLAGS  = TCA_SINGLE_OVF_bm; // Always remember to clear the interrupt flags, otherwise the interrupt will fire continually!
 }
 
 
-ISR(TCA0_CMP0_vect) {    // on compare, get next pixel and set state
+ISR(TCA0_CMP0_vect) {    // on compare, energise the preloaded pixel
   if (index >= 35) {
-    shift32(0);
+    index ++;
+  } else if (preloadDone()) {
     clockRegisters();
+    recordLatency(TCA0.SINGLE.CMP0 - TCA0.SINGLE.CNT);
+    index ++;
   } else {
-    shift32(registerFrames[index]);
-    clockRegisters();
+    preloadUnderruns ++;  // latching now would energise a half shifted word - retry this pixel next slot
   }
-  index ++;
   TCA0.SINGLE.INTFLAGS  = TCA_SINGLE_CMP0_bm; // Always remember to clear the interrupt flags, otherwise the interrupt will fire continually!
-}
\ No newline at end of file
+}
+
@@ -0,0 +1,168 @@
+/*
+
+  Arduino.h - Host simulator stand-in for the megaTinyCore Arduino core.
+
+  Only what the driver board firmware uses is provided. Peripheral registers
+  are plain fields that the simulator polls every cycle, except where a
+  write has a side effect (SPI0.DATA, write-one-to-clear flags).
+
+*/
+
+#ifndef SimArduino_h
+#define SimArduino_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define F_CPU 10000000UL
+
+#define HIGH 1
+#define LOW 0
+
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+
+#define SERIAL_8N1 0x03
+#define SERIAL_OPENDRAIN 0x100
+#define SERIAL_LOOPBACK 0x200
+#define SERIAL_HALF_DUPLEX (SERIAL_OPENDRAIN | SERIAL_LOOPBACK)
+
+#define SERIAL_RX_BUFFER_SIZE 32
+#define SERIAL_TX_BUFFER_SIZE 16
+
+// Serial.getStatus() flags, as in megaTinyCore 2.6
+#define SERIAL_OVERFLOW_RING 0x40
+#define SERIAL_OVERFLOW_HARDWARE 0x80
+
+#define bitRead(value, bit) (((value) >> (bit)) & 0x01)
+#define bitSet(value, bit) ((value) |= (1UL << (bit)))
+#define bitClear(value, bit) ((value) &= ~(1UL << (bit)))
+#define bitWrite(value, bit, bitvalue) ((bitvalue) ? bitSet(value, bit) : bitClear(value, bit))
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+// Vectors become plain functions the simulator dispatches
+#define ISR(vector) void vector##_isr()
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+void digitalWriteFast(uint8_t pin, uint8_t value);
+uint8_t digitalRead(uint8_t pin);
+
+unsigned long millis();
+unsigned long micros();
+
+void noInterrupts();
+void interrupts();
+
+// Clock controller
+extern volatile uint8_t CLKCTRL_MCLKCTRLB;
+#define CLKCTRL_PEN_bm 0x01
+#define _PROTECTED_WRITE(reg, value) ((reg) = (value))
+
+// Write-one-to-clear interrupt flag register
+class SimFlagRegister {
+public:
+  volatile uint8_t flags = 0;
+  SimFlagRegister& operator=(uint8_t value) {
+    flags &= ~value;
+    return *this;
+  }
+  operator uint8_t() const { return flags; }
+};
+
+// Flag register the firmware busy-waits on - each read lets simulated time pass
+namespace sim { void pollRegister(); }
+
+class SimPolledFlagRegister : public SimFlagRegister {
+public:
+  SimPolledFlagRegister& operator=(uint8_t value) {
+    SimFlagRegister::operator=(value);
+    return *this;
+  }
+  operator uint8_t() const {
+    sim::pollRegister();
+    return flags;
+  }
+};
+
+// TCA0 in single (16 bit) mode
+struct SimTCASingle {
+  volatile uint8_t CTRLA = 0;
+  volatile uint8_t CTRLB = 0;
+  volatile uint8_t CTRLESET = 0;
+  volatile uint8_t INTCTRL = 0;
+  SimFlagRegister INTFLAGS;
+  volatile uint16_t CNT = 0;
+  volatile uint16_t PER = 0xFFFF;
+  volatile uint16_t CMP0 = 0;
+  volatile uint16_t PERBUF = 0;
+  volatile uint16_t CMP0BUF = 0;
+};
+
+struct SimTCA {
+  SimTCASingle SINGLE;
+};
+
+extern SimTCA TCA0;
+
+void takeOverTCA0();
+
+#define TCA_SINGLE_ENABLE_bm 0x01
+#define TCA_SINGLE_DIR_DOWN_gc 0x01
+#define TCA_SINGLE_OVF_bm 0x01
+#define TCA_SINGLE_CMP0_bm 0x10
+
+// SPI0 - a DATA write starts or queues a transfer
+class SimSpiData {
+public:
+  SimSpiData& operator=(uint8_t value);
+  operator uint8_t() const;
+};
+
+struct SimSPI {
+  volatile uint8_t CTRLA = 0;
+  volatile uint8_t CTRLB = 0;
+  volatile uint8_t INTCTRL = 0;
+  SimPolledFlagRegister INTFLAGS;
+  SimSpiData DATA;
+};
+
+extern SimSPI SPI0;
+
+#define SPI_ENABLE_bm 0x01
+#define SPI_PRESC_DIV4_gc 0x00
+#define SPI_PRESC_DIV16_gc 0x02
+#define SPI_PRESC_DIV64_gc 0x04
+#define SPI_PRESC_DIV128_gc 0x06
+#define SPI_PRESC_gm 0x06
+#define SPI_CLK2X_bm 0x10
+#define SPI_MASTER_bm 0x20
+#define SPI_MODE_0_gc 0x00
+#define SPI_SSD_bm 0x04
+#define SPI_BUFEN_bm 0x80
+#define SPI_IE_bm 0x01
+#define SPI_DREIE_bm 0x20
+#define SPI_TXCIE_bm 0x40
+#define SPI_IF_bm 0x80
+#define SPI_DREIF_bm 0x20
+#define SPI_TXCIF_bm 0x40
+
+// USART0 as seen through the Arduino Serial object
+class SimSerial {
+public:
+  void begin(unsigned long baud, uint16_t options = SERIAL_8N1);
+  void end();
+  int available();
+  int read();
+  int peek();
+  int availableForWrite();
+  size_t write(uint8_t value);
+  void flush();
+  uint8_t getStatus();
+  operator bool() const { return true; }
+};
+
+extern SimSerial Serial;
+
+#endif
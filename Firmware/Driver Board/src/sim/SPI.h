@@ -0,0 +1,21 @@
+/*
+
+  SPI.h - Host simulator stand-in for the megaTinyCore SPI library.
+
+*/
+
+#ifndef SimSPI_h
+#define SimSPI_h
+
+#include "Arduino.h"
+
+class SimSPIClass {
+public:
+  void begin() {
+    SPI0.CTRLA = SPI_MASTER_bm | SPI_ENABLE_bm;
+  }
+};
+
+extern SimSPIClass SPI;
+
+#endif
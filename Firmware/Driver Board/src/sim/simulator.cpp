@@ -0,0 +1,785 @@
+/*
+
+  simulator.cpp - Cycle stepped host simulator for the driver board firmware.
+
+  Runs ../main.cpp unmodified against models of TCA0, SPI0, USART0 receive
+  timing, the 74HC595 chain and the address pins, all stepped at the 10 MHz
+  core clock. ISRs are dispatched with AVR priority and entry latency; the
+  cost of firmware code itself is estimated per ISR and per loop() pass.
+
+  Build and run:
+    pio run -e simulator
+    .pio/build/simulator/program [options]
+
+  Options:
+    --baud N                line rate the input starts at (115200)
+    --address N             module address set on the ADDR pins (0)
+    --input FILE            protocol bytes as hex text, '@<ms>' sets the send time, '!<baud>' the line rate, '#' comments
+    --frames N              generate N scrolling frames instead (100)
+    --modules N             modules addressed by generated frames (8)
+    --frame-interval-ms N   time between generated frames (16)
+    --link BAUD             switch generated frames to a register 13 rate (250000 or 500000) and send them as bursts
+    --duration-ms N         stop after N ms (input end + 500)
+    --trace FILE            write the shift register and dot-state timeline as CSV
+
+*/
+
+#include "Arduino.h"
+#include "SPI.h"
+
+namespace firmware {
+// Vectors the firmware doesn't implement resolve to null
+__attribute__((weak)) void TCA0_OVF_vect_isr();
+__attribute__((weak)) void TCA0_CMP0_vect_isr();
+__attribute__((weak)) void SPI0_INT_vect_isr();
+#include "../main.cpp"
+}
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <deque>
+#include <string>
+#include <vector>
+
+// Firmware cost estimates in core clock cycles
+#define ISR_ENTRY_CYCLES 20        // response, vector jump and prologue
+#define TCA_ISR_CYCLES 70
+#define SPI_ISR_CYCLES 40
+#define RXC_ISR_CYCLES 50
+#define LOOP_PASS_CYCLES 60
+#define LOOP_BYTE_CYCLES 80        // per byte handled by loop()
+#define LOOP_SWEEP_CYCLES 3500     // genStates and sweep restart
+#define LOOP_TX_BYTE_CYCLES 40
+#define POLL_CYCLES 4              // one lds/sbrs/rjmp pass of a busy-wait
+
+#define USART_RX_FIFO 2
+
+enum Vector {
+  VECTOR_TCA0_OVF,
+  VECTOR_TCA0_CMP0,
+  VECTOR_SPI0_INT,
+  VECTOR_USART0_RXC,
+  VECTOR_COUNT
+};
+
+struct ScheduledByte {
+  uint64_t at;
+  uint8_t value;
+  unsigned long baud;
+};
+
+namespace sim {
+  uint64_t cycles = 0;
+  bool interruptsEnabled = true;
+
+  uint8_t pins[16] = {0};
+  uint8_t address = 0;
+
+  // 74HC595 chain
+  uint32_t shiftStage = 0;
+  uint32_t outputStage = 0;
+  uint64_t pulseStart = 0;
+  uint8_t dots[5] = {0};
+
+  // SPI0
+  bool spiShifting = false;
+  uint8_t spiShifter = 0;
+  uint32_t spiRemaining = 0;
+  bool spiBufferFull = false;
+  uint8_t spiBuffer = 0;
+  uint64_t spiIdleAt = 0;  // when the last transfer finished
+
+  // TCA0 buffer valid tracking
+  uint16_t perbufSeen = 0;
+  uint16_t cmp0bufSeen = 0;
+  uint64_t tcaRaisedAt[2] = {0};
+
+  // USART0
+  unsigned long firmwareBaud = 0;
+  unsigned long lineBaud = 115200;
+  std::deque<uint8_t> rxFifo;
+  std::deque<uint8_t> rxRing;
+  uint8_t serialStatus = 0;   // overflow flags until Serial.getStatus() reads them
+  uint8_t txRing = 0;         // bytes waiting behind the one on the line
+  uint64_t txFreeAt = 0;      // when the byte on the line has gone
+  std::vector<ScheduledByte> input;
+  size_t inputNext = 0;
+
+  // CPU
+  enum CpuState { CPU_MAIN, CPU_ISR_ENTRY, CPU_ISR_BODY } cpuState = CPU_MAIN;
+  uint32_t cpuBusy = 0;
+  uint32_t mainBusy = 0;
+  int activeVector = -1;
+
+  // Statistics
+  uint32_t bytesFed = 0;
+  uint32_t bytesRead = 0;
+  uint32_t framingErrors = 0;
+  uint32_t fifoOverruns = 0;
+  uint32_t ringDrops = 0;
+  uint32_t txBytes = 0;
+  uint32_t pulses = 0;
+  uint32_t flips = 0;
+  uint32_t conflicts = 0;
+  uint64_t pulseMin = UINT64_MAX;
+  uint64_t pulseMax = 0;
+  uint64_t latencyMax = 0;
+  uint64_t preloadSlackMin = UINT64_MAX;  // from a preload finishing to the energise that uses it
+  uint64_t ovfBusyMax = 0;                // underflow ISR, entry to return
+  uint64_t firstFlipAt = 0;
+  uint64_t lastFlipAt = 0;
+  uint64_t lastByteAt = 0;
+
+  FILE* trace = nullptr;
+
+  double us(uint64_t at) {
+    return at / (F_CPU / 1000000.0);
+  }
+
+  void writeTrace(const char* event, uint32_t word) {
+    if (!trace) {
+      return;
+    }
+    fprintf(trace, "%.1f,%s,%08x,%02x %02x %02x %02x %02x\n",
+      us(cycles), event, word, dots[0], dots[1], dots[2], dots[3], dots[4]);
+  }
+
+  // Apply the coil currents of a finished pulse to the dot model
+  void endPulse(uint32_t word) {
+    uint64_t width = cycles - pulseStart;
+    pulses ++;
+    if (width < pulseMin) {
+      pulseMin = width;
+    }
+    if (width > pulseMax) {
+      pulseMax = width;
+    }
+
+    for (int x = 0; x < 5; x++) {
+      bool colHigh = bitRead(word, firmware::colHigh[x]);
+      bool colLow = bitRead(word, firmware::colLow[x]);
+      if (colHigh && colLow) {
+        conflicts ++;
+        continue;
+      }
+      for (int y = 0; y < 7; y++) {
+        bool rowHigh = bitRead(word, firmware::rowHigh[y]);
+        bool rowLow = bitRead(word, firmware::rowLow[y]);
+        if (rowHigh && rowLow) {
+          conflicts ++;
+          continue;
+        }
+        int value = -1;
+        if (colLow && rowHigh) {
+          value = 1;
+        } else if (colHigh && rowLow) {
+          value = 0;
+        }
+        if (value >= 0 && bitRead(dots[x], y) != value) {
+          bitWrite(dots[x], y, value);
+          flips ++;
+          if (!firstFlipAt) {
+            firstFlipAt = cycles;
+          }
+          lastFlipAt = cycles;
+        }
+      }
+    }
+    writeTrace("release", word);
+  }
+
+  void latch() {
+    uint32_t word = shiftStage;
+    if (activeVector == VECTOR_TCA0_OVF || activeVector == VECTOR_TCA0_CMP0) {
+      uint64_t latency = cycles - tcaRaisedAt[activeVector];
+      if (latency > latencyMax) {
+        latencyMax = latency;
+      }
+    }
+    if (word && activeVector == VECTOR_TCA0_CMP0 && cycles - spiIdleAt < preloadSlackMin) {
+      preloadSlackMin = cycles - spiIdleAt;
+    }
+    if (word == outputStage) {
+      return;
+    }
+    if (outputStage) {
+      endPulse(outputStage);
+    }
+    outputStage = word;
+    if (word) {
+      pulseStart = cycles;
+      writeTrace("energise", word);
+    }
+  }
+
+  void setPin(uint8_t pin, uint8_t value) {
+    uint8_t previous = pins[pin];
+    pins[pin] = value;
+    if (pin == RCLK && !previous && value) {
+      latch();
+    }
+    if (pin == SRCLR && !value) {
+      shiftStage = 0;
+    }
+  }
+
+  uint32_t spiByteCycles() {
+    static const uint8_t divider[4] = {4, 16, 64, 128};
+    uint32_t cyclesPerBit = divider[(SPI0.CTRLA & SPI_PRESC_gm) >> 1];
+    if (SPI0.CTRLA & SPI_CLK2X_bm) {
+      cyclesPerBit /= 2;
+    }
+    return 8 * cyclesPerBit;
+  }
+
+  void spiWrite(uint8_t value) {
+    if (!(SPI0.CTRLA & SPI_ENABLE_bm)) {
+      return;
+    }
+    if (!spiShifting) {
+      spiShifting = true;
+      spiShifter = value;
+      spiRemaining = spiByteCycles();
+    } else if ((SPI0.CTRLB & SPI_BUFEN_bm) && !spiBufferFull) {
+      spiBufferFull = true;
+      spiBuffer = value;
+    } // else the write collides with a transfer in progress and is lost
+    if (SPI0.CTRLB & SPI_BUFEN_bm) {
+      SPI0.INTFLAGS.flags &= ~SPI_TXCIF_bm;
+      if (spiBufferFull) {
+        SPI0.INTFLAGS.flags &= ~SPI_DREIF_bm;
+      }
+    } else {
+      SPI0.INTFLAGS.flags &= ~SPI_IF_bm;
+    }
+  }
+
+  void stepSpi() {
+    if (!spiShifting) {
+      return;
+    }
+    if (--spiRemaining) {
+      return;
+    }
+    shiftStage = (shiftStage << 8) | spiShifter;  // MSB first into the chain
+    if (SPI0.CTRLB & SPI_BUFEN_bm) {
+      if (spiBufferFull) {
+        spiShifter = spiBuffer;
+        spiBufferFull = false;
+        spiRemaining = spiByteCycles();
+        SPI0.INTFLAGS.flags |= SPI_DREIF_bm;
+      } else {
+        spiShifting = false;
+        spiIdleAt = cycles;
+        SPI0.INTFLAGS.flags |= SPI_TXCIF_bm | SPI_DREIF_bm;
+      }
+    } else {
+      spiShifting = false;
+      SPI0.INTFLAGS.flags |= SPI_IF_bm;
+    }
+  }
+
+  void stepTca() {
+    SimTCASingle& tca = TCA0.SINGLE;
+    if (!(tca.CTRLA & TCA_SINGLE_ENABLE_bm)) {
+      return;
+    }
+    if (tca.CNT == 0) {  // underflow - UPDATE condition
+      if (tca.PERBUF != perbufSeen) {
+        perbufSeen = tca.PERBUF;
+        tca.PER = tca.PERBUF;
+      }
+      if (tca.CMP0BUF != cmp0bufSeen) {
+        cmp0bufSeen = tca.CMP0BUF;
+        tca.CMP0 = tca.CMP0BUF;
+      }
+      tca.CNT = tca.PER;
+      tca.INTFLAGS.flags |= TCA_SINGLE_OVF_bm;
+      tcaRaisedAt[VECTOR_TCA0_OVF] = cycles;
+    } else {
+      tca.CNT = tca.CNT - 1;
+    }
+    if (tca.CNT == tca.CMP0) {
+      tca.INTFLAGS.flags |= TCA_SINGLE_CMP0_bm;
+      tcaRaisedAt[VECTOR_TCA0_CMP0] = cycles;
+    }
+  }
+
+  void stepUart() {
+    while (inputNext < input.size() && input[inputNext].at <= cycles) {
+      uint8_t value = input[inputNext].value;
+      inputNext ++;
+      bytesFed ++;
+      lastByteAt = cycles;
+      if (firmwareBaud != input[inputNext - 1].baud) {
+        framingErrors ++;
+      } else if (rxFifo.size() >= USART_RX_FIFO) {
+        fifoOverruns ++;
+        serialStatus |= SERIAL_OVERFLOW_HARDWARE;
+      } else {
+        rxFifo.push_back(value);
+      }
+    }
+    if (txRing && cycles >= txFreeAt && firmwareBaud) {  // the next queued byte goes on the line
+      txRing --;
+      txFreeAt = cycles + (10ULL * F_CPU + firmwareBaud - 1) / firmwareBaud;
+    }
+  }
+
+  bool vectorPending(int vector) {
+    switch (vector) {
+      case VECTOR_TCA0_OVF:
+        return TCA0.SINGLE.INTFLAGS.flags & TCA0.SINGLE.INTCTRL & TCA_SINGLE_OVF_bm;
+      case VECTOR_TCA0_CMP0:
+        return TCA0.SINGLE.INTFLAGS.flags & TCA0.SINGLE.INTCTRL & TCA_SINGLE_CMP0_bm;
+      case VECTOR_SPI0_INT:
+        if (SPI0.CTRLB & SPI_BUFEN_bm) {
+          return SPI0.INTFLAGS.flags & SPI0.INTCTRL & (SPI_DREIF_bm | SPI_TXCIF_bm);
+        }
+        return (SPI0.INTCTRL & SPI_IE_bm) && (SPI0.INTFLAGS.flags & SPI_IF_bm);
+      case VECTOR_USART0_RXC:
+        return !rxFifo.empty();
+    }
+    return false;
+  }
+
+  void callVector(void (*isr)()) {
+    if (isr) {
+      isr();
+    }
+  }
+
+  uint32_t runVector(int vector) {
+    activeVector = vector;
+    switch (vector) {
+      case VECTOR_TCA0_OVF: {
+        uint64_t start = cycles;
+        callVector(firmware::TCA0_OVF_vect_isr);
+        uint64_t busy = ISR_ENTRY_CYCLES + (cycles - start) + TCA_ISR_CYCLES;  // time spent polling, plus the estimate
+        if (busy > ovfBusyMax) {
+          ovfBusyMax = busy;
+        }
+        return TCA_ISR_CYCLES;
+      }
+      case VECTOR_TCA0_CMP0:
+        callVector(firmware::TCA0_CMP0_vect_isr);
+        return TCA_ISR_CYCLES;
+      case VECTOR_SPI0_INT:
+        callVector(firmware::SPI0_INT_vect_isr);
+        return SPI_ISR_CYCLES;
+      case VECTOR_USART0_RXC:
+        while (!rxFifo.empty()) {
+          if (rxRing.size() < SERIAL_RX_BUFFER_SIZE - 1) {
+            rxRing.push_back(rxFifo.front());
+          } else {
+            ringDrops ++;
+            serialStatus |= SERIAL_OVERFLOW_RING;
+          }
+          rxFifo.pop_front();
+        }
+        return RXC_ISR_CYCLES;
+    }
+    return 0;
+  }
+
+  uint32_t runLoopPass() {
+    uint32_t readBefore = bytesRead;
+    uint32_t txBefore = txBytes;
+    bool timerBefore = TCA0.SINGLE.CTRLA & TCA_SINGLE_ENABLE_bm;
+    activeVector = -1;
+    firmware::loop();
+    bool timerAfter = TCA0.SINGLE.CTRLA & TCA_SINGLE_ENABLE_bm;
+    return LOOP_PASS_CYCLES
+      + (bytesRead - readBefore) * LOOP_BYTE_CYCLES
+      + (txBytes - txBefore) * LOOP_TX_BYTE_CYCLES
+      + ((!timerBefore && timerAfter) ? LOOP_SWEEP_CYCLES : 0);
+  }
+
+  void pollRegister() {  // peripherals keep running while the firmware spins
+    for (int i = 0; i < POLL_CYCLES; i++) {
+      stepTca();
+      stepSpi();
+      stepUart();
+      cycles ++;
+    }
+  }
+
+  void step() {
+    stepTca();
+    stepSpi();
+    stepUart();
+
+    switch (cpuState) {
+      case CPU_ISR_ENTRY:
+        if (--cpuBusy == 0) {
+          cpuBusy = runVector(activeVector);
+          cpuState = CPU_ISR_BODY;
+        }
+        break;
+      case CPU_ISR_BODY:
+        if (--cpuBusy == 0) {
+          cpuState = CPU_MAIN;
+          activeVector = -1;
+        }
+        break;
+      case CPU_MAIN:
+        if (interruptsEnabled) {
+          for (int vector = 0; vector < VECTOR_COUNT; vector++) {
+            if (vectorPending(vector)) {
+              activeVector = vector;
+              cpuState = CPU_ISR_ENTRY;
+              cpuBusy = ISR_ENTRY_CYCLES;
+              break;
+            }
+          }
+          if (cpuState != CPU_MAIN) {
+            break;
+          }
+        }
+        if (mainBusy) {
+          mainBusy --;
+        } else {
+          mainBusy = runLoopPass();
+        }
+        break;
+    }
+    cycles ++;
+  }
+}
+
+// Arduino core stand-ins
+volatile uint8_t CLKCTRL_MCLKCTRLB = 0;
+SimTCA TCA0;
+SimSPI SPI0;
+SimSerial Serial;
+SimSPIClass SPI;
+
+void pinMode(uint8_t pin, uint8_t mode) {
+  if (mode == INPUT_PULLUP) {
+    sim::pins[pin] = HIGH;
+  }
+}
+
+void digitalWrite(uint8_t pin, uint8_t value) {
+  sim::setPin(pin, value);
+}
+
+void digitalWriteFast(uint8_t pin, uint8_t value) {
+  sim::setPin(pin, value);
+}
+
+uint8_t digitalRead(uint8_t pin) {
+  switch (pin) {
+    case ADDR_0:
+      return bitRead(sim::address, 0);
+    case ADDR_1:
+      return bitRead(sim::address, 1);
+    case ADDR_2:
+      return bitRead(sim::address, 2);
+  }
+  return sim::pins[pin];
+}
+
+unsigned long millis() {
+  return sim::cycles / (F_CPU / 1000);
+}
+
+unsigned long micros() {
+  return sim::cycles / (F_CPU / 1000000);
+}
+
+void noInterrupts() {
+  sim::interruptsEnabled = false;
+}
+
+void interrupts() {
+  sim::interruptsEnabled = true;
+}
+
+void takeOverTCA0() {
+  TCA0.SINGLE.CTRLA = 0;
+}
+
+SimSpiData& SimSpiData::operator=(uint8_t value) {
+  sim::spiWrite(value);
+  return *this;
+}
+
+SimSpiData::operator uint8_t() const {
+  return 0;
+}
+
+void SimSerial::begin(unsigned long baud, uint16_t) {
+  sim::firmwareBaud = baud;
+}
+
+void SimSerial::end() {
+  sim::firmwareBaud = 0;
+}
+
+int SimSerial::available() {
+  return sim::rxRing.size();
+}
+
+int SimSerial::read() {
+  if (sim::rxRing.empty()) {
+    return -1;
+  }
+  uint8_t value = sim::rxRing.front();
+  sim::rxRing.pop_front();
+  sim::bytesRead ++;
+  return value;
+}
+
+int SimSerial::peek() {
+  return sim::rxRing.empty() ? -1 : sim::rxRing.front();
+}
+
+int SimSerial::availableForWrite() {
+  return SERIAL_TX_BUFFER_SIZE - 1 - sim::txRing;
+}
+
+size_t SimSerial::write(uint8_t value) {
+  while (availableForWrite() == 0) {
+    sim::pollRegister();
+  }
+  sim::txRing ++;
+  sim::txBytes ++;
+  if (sim::trace) {
+    fprintf(sim::trace, "%.1f,tx,%02x,\n", sim::us(sim::cycles), value);
+  }
+  return 1;
+}
+
+void SimSerial::flush() {
+  while (sim::txRing || sim::cycles < sim::txFreeAt) {
+    sim::pollRegister();
+  }
+}
+
+uint8_t SimSerial::getStatus() {
+  uint8_t status = sim::serialStatus;
+  sim::serialStatus = 0;
+  return status;
+}
+
+// Input generation
+
+uint64_t byteCycles(unsigned long baud) {
+  return (10ULL * F_CPU + baud - 1) / baud;  // start, 8 data, stop
+}
+
+bool loadInput(const char* path, unsigned long baud) {
+  FILE* file = fopen(path, "r");
+  if (!file) {
+    perror(path);
+    return false;
+  }
+  uint64_t at = 0;
+  char token[64];
+  while (fscanf(file, "%63s", token) == 1) {
+    if (token[0] == '#') {
+      int c;
+      while ((c = fgetc(file)) != EOF && c != '\n');
+    } else if (token[0] == '@') {
+      uint64_t start = (uint64_t)(atof(token + 1) * (F_CPU / 1000));
+      if (start > at) {
+        at = start;
+      }
+    } else if (token[0] == '!') {
+      baud = strtoul(token + 1, nullptr, 10);
+    } else {
+      at += byteCycles(baud);
+      sim::input.push_back({at, (uint8_t)strtoul(token, nullptr, 16), baud});
+    }
+  }
+  fclose(file);
+  return true;
+}
+
+struct InputWriter {
+  uint64_t at = 0;
+  unsigned long baud;
+
+  void write(uint8_t value) {
+    at += byteCycles(baud);
+    sim::input.push_back({at, value, baud});
+  }
+
+  void burst(uint8_t module, const uint8_t* payload, uint8_t length) {  // register 14
+    write(0b10001110 | (module << 4));
+    write(length);
+    uint8_t crc = firmware::crc7(0, length);
+    for (uint8_t i = 0; i < length; i++) {
+      write(payload[i]);
+      crc = firmware::crc7(crc, payload[i]);
+    }
+    write(crc);
+  }
+};
+
+// Scrolling pattern in the controller's framing: select register 0, five columns, select register 5.
+// In link mode the same columns go out as one burst per module.
+void generateInput(unsigned long baud, int frames, int modules, double intervalMs, uint8_t linkRate) {
+  InputWriter writer;
+  writer.baud = baud;
+  for (int module = 0; module < modules; module++) {  // vertical raster mode, as the controller sends columns
+    writer.write(0b10001000 | (module << 4));
+    writer.write(0b00000001);
+  }
+  if (linkRate) {
+    for (int module = 0; module < modules; module++) {
+      writer.write(0b10001101 | (module << 4));
+      writer.write(linkRate);
+    }
+    writer.at += 2 * (F_CPU / 1000);  // let every module switch before talking at the new rate
+    writer.baud = firmware::linkRates[linkRate];
+  }
+  for (int frame = 0; frame < frames; frame++) {
+    uint64_t frameStart = (uint64_t)(frame * intervalMs * (F_CPU / 1000));
+    if (frameStart > writer.at) {
+      writer.at = frameStart;
+    }
+    for (int module = 0; module < modules; module++) {
+      uint8_t payload[6] = {0};
+      for (int x = 0; x < 5; x++) {
+        uint32_t column = module * 5 + x + frame;
+        payload[1 + x] = (column * 2654435761u) >> 25;
+      }
+      if (linkRate) {
+        writer.burst(module, payload, 6);
+      } else {
+        writer.write(0b10000000 | (module << 4));
+        for (int x = 0; x < 5; x++) {
+          writer.write(payload[1 + x]);
+        }
+        writer.write(0b10000101 | (module << 4));
+      }
+    }
+  }
+}
+
+void report() {
+  printf("Simulated %.3f ms, line started at %lu baud and finished at %lu, module address %u\n",
+    sim::us(sim::cycles) / 1000, sim::lineBaud, sim::firmwareBaud, sim::address);
+  printf("Input: %u bytes fed, %u read, %u dropped (%u framing, %u hardware overrun, %u buffer full)\n",
+    sim::bytesFed, sim::bytesRead, sim::framingErrors + sim::fifoOverruns + sim::ringDrops,
+    sim::framingErrors, sim::fifoOverruns, sim::ringDrops);
+  if (sim::pulses) {
+    printf("Pulses: %u, width %.1f - %.1f us, %u H-bridge conflicts\n",
+      sim::pulses, sim::us(sim::pulseMin), sim::us(sim::pulseMax), sim::conflicts);
+  } else {
+    printf("Pulses: 0\n");
+  }
+  double flipWindow = sim::us(sim::lastFlipAt - sim::firstFlipAt) / 1000000;
+  printf("Dot flips: %u", sim::flips);
+  if (flipWindow > 0) {
+    printf(" (%.0f flips/s)", sim::flips / flipWindow);
+  }
+  printf("\n");
+  printf("ISR latency, timer event to RCLK edge: max %.1f us\n", sim::us(sim::latencyMax));
+  if (sim::preloadSlackMin != UINT64_MAX) {
+    printf("Preload: underflow ISR busy up to %.1f us, done at least %.1f us before energise, %u slots skipped\n",
+      sim::us(sim::ovfBusyMax), sim::us(sim::preloadSlackMin), firmware::preloadUnderruns);
+  }
+  if (sim::bytesFed) {
+    printf("Last byte at %.3f ms, last dot latched at %.3f ms", sim::us(sim::lastByteAt) / 1000, sim::us(sim::lastFlipAt) / 1000);
+    if (sim::lastFlipAt >= sim::lastByteAt) {
+      printf(", latency %.3f ms", sim::us(sim::lastFlipAt - sim::lastByteAt) / 1000);
+    }
+    printf("\n");
+  }
+  if (sim::txBytes) {
+    printf("Bytes transmitted: %u\n", sim::txBytes);
+  }
+  printf("Link: %lu baud at the end, %u bursts dropped, %u passes found input lost\n",
+    sim::firmwareBaud, firmware::crcErrors, firmware::rxOverruns);
+}
+
+int main(int argc, char** argv) {
+  const char* inputPath = nullptr;
+  const char* tracePath = nullptr;
+  int frames = 100;
+  int modules = 8;
+  double intervalMs = 16;
+  double durationMs = -1;
+  uint8_t linkRate = 0;
+
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    const char* value = (i + 1 < argc) ? argv[i + 1] : nullptr;
+    if (!value) {
+      fprintf(stderr, "Missing value for %s\n", arg.c_str());
+      return 1;
+    }
+    if (arg == "--baud") {
+      sim::lineBaud = strtoul(value, nullptr, 10);
+    } else if (arg == "--address") {
+      sim::address = strtoul(value, nullptr, 10) & 0b111;
+    } else if (arg == "--input") {
+      inputPath = value;
+    } else if (arg == "--frames") {
+      frames = atoi(value);
+    } else if (arg == "--modules") {
+      modules = constrain(atoi(value), 1, 8);
+    } else if (arg == "--frame-interval-ms") {
+      intervalMs = atof(value);
+    } else if (arg == "--duration-ms") {
+      durationMs = atof(value);
+    } else if (arg == "--link") {
+      unsigned long baud = strtoul(value, nullptr, 10);
+      linkRate = LINK_RATE_COUNT;
+      for (uint8_t rate = 0; rate < LINK_RATE_COUNT; rate++) {
+        if (firmware::linkRates[rate] == baud) {
+          linkRate = rate;
+        }
+      }
+      if (linkRate == LINK_RATE_COUNT) {
+        fprintf(stderr, "No link rate of %s baud\n", value);
+        return 1;
+      }
+    } else if (arg == "--trace") {
+      tracePath = value;
+    } else {
+      fprintf(stderr, "Unknown option %s\n", arg.c_str());
+      return 1;
+    }
+    i++;
+  }
+
+  if (inputPath) {
+    if (!loadInput(inputPath, sim::lineBaud)) {
+      return 1;
+    }
+  } else {
+    generateInput(sim::lineBaud, frames, modules, intervalMs, linkRate);
+  }
+
+  if (tracePath) {
+    sim::trace = fopen(tracePath, "w");
+    if (!sim::trace) {
+      perror(tracePath);
+      return 1;
+    }
+    fprintf(sim::trace, "time_us,event,value,dots\n");
+  }
+
+  uint64_t end;
+  if (durationMs >= 0) {
+    end = (uint64_t)(durationMs * (F_CPU / 1000));
+  } else {
+    end = (sim::input.empty() ? 0 : sim::input.back().at) + 500 * (F_CPU / 1000);
+  }
+
+  firmware::setup();
+  while (sim::cycles < end) {
+    sim::step();
+  }
+
+  report();
+  if (sim::trace) {
+    fclose(sim::trace);
+  }
+  return 0;
+}
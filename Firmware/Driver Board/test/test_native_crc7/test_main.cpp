@@ -0,0 +1,81 @@
+/*
+
+  CRC-7 as link mode bursts are checked with it.
+  Runs on the host: pio test -e native -f test_native_crc7
+
+*/
+
+#include <unity.h>
+#include <string.h>
+
+#include "../../src/crc7.h"
+
+#define BURST_BYTES 10  // header aside, the longest burst: length, start register, 7 values, CRC
+
+void setUp() {}
+void tearDown() {}
+
+uint8_t crcOf(const uint8_t* bytes, uint8_t length) {
+  uint8_t crc = 0;
+  for (uint8_t i = 0; i < length; i++) {
+    crc = crc7(crc, bytes[i]);
+  }
+  return crc;
+}
+
+// SD card commands carry the same CRC, shifted up with a stop bit
+void test_known_values() {
+  const uint8_t cmd0[] = {0x40, 0x00, 0x00, 0x00, 0x00};
+  const uint8_t cmd8[] = {0x48, 0x00, 0x00, 0x01, 0xAA};
+  const uint8_t cmd17[] = {0x51, 0x00, 0x00, 0x00, 0x00};
+  TEST_ASSERT_EQUAL_HEX8(0x95, crcOf(cmd0, 5) << 1 | 1);
+  TEST_ASSERT_EQUAL_HEX8(0x87, crcOf(cmd8, 5) << 1 | 1);
+  TEST_ASSERT_EQUAL_HEX8(0x55, crcOf(cmd17, 5) << 1 | 1);
+}
+
+void test_fits_a_septet() {
+  for (int crc = 0; crc < 128; crc++) {
+    for (int val = 0; val < 256; val++) {
+      TEST_ASSERT_EQUAL(0, crc7(crc, val) & 0x80);
+    }
+  }
+}
+
+// A frame burst as the controller sends it: length 6, register 0, five columns
+void test_frame_burst() {
+  uint8_t burst[] = {6, 0, 0x7F, 0x41, 0x41, 0x41, 0x7F, 0};
+  burst[7] = crcOf(burst, 7);
+  TEST_ASSERT_EQUAL(0, crcOf(burst, 7) & 0x80);
+  burst[3] ^= 0x04;
+  TEST_ASSERT_TRUE(crcOf(burst, 7) != burst[7]);
+}
+
+// The polynomial's period is 127 bits, so every one and two bit error in a burst is caught
+void test_bit_errors_caught() {
+  uint8_t burst[BURST_BYTES] = {8, 0, 0x12, 0x34, 0x56, 0x78, 0x1A, 0x2B, 0x3C, 0};
+  burst[BURST_BYTES - 1] = crcOf(burst, BURST_BYTES - 1);
+  int missed = 0;
+  for (int first = 0; first < BURST_BYTES * 8; first++) {
+    for (int second = first; second < BURST_BYTES * 8; second++) {
+      uint8_t damaged[BURST_BYTES];
+      memcpy(damaged, burst, BURST_BYTES);
+      damaged[first / 8] ^= 1 << (first % 8);
+      if (second != first) {
+        damaged[second / 8] ^= 1 << (second % 8);
+      }
+      if (crcOf(damaged, BURST_BYTES - 1) == (damaged[BURST_BYTES - 1] & 0x7F) && !(damaged[BURST_BYTES - 1] & 0x80)) {
+        missed++;
+      }
+    }
+  }
+  TEST_ASSERT_EQUAL(0, missed);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_known_values);
+  RUN_TEST(test_fits_a_septet);
+  RUN_TEST(test_frame_burst);
+  RUN_TEST(test_bit_errors_caught);
+  return UNITY_END();
+}
@@ -1,6 +1,13 @@
 #include <Arduino.h>
-#include <SPI.h>
 #include <Adafruit_GFX.h>
+#include "driver/spi_master.h"
+#include "esp_heap_caps.h"
+#include "soc/gpio_struct.h"
+#include "esp_timer.h"
+#include <DisplayBackend.h>
+
+#include <vector>
+#include <algorithm>
 
 #include <menu.h>
 #include <menuIO/serialOut.h>
@@ -17,6 +24,19 @@
 #define DISPLAY_WIDTH 35
 #define DISPLAY_HEIGHT 7
 
+#define MODULES 7
+#define SLOTS 35
+#define SLOT_BYTES (MODULES * 4)
+#define FRAME_BYTES (SLOTS * SLOT_BYTES)
+
+#define RCLK_PIN 5
+#define SPI_SCK_PIN 18
+#define SPI_MOSI_PIN 23
+#define SPI_CLOCK_HZ 4000000
+
+#define PULSE_RETRY_US 20           // wait before latching again when a transfer hasn't finished
+#define PULSE_MIN_RECOVERY_US 100   // leaves room to shift the next slot in
+
 #define SCROLL_CANVAS_HEIGHT 8
 #define SCROLL_CANVAS_WIDTH 36
 
@@ -79,7 +99,17 @@ int colLow[5] = {9, 10, 11, 26, 25};
 uint32_t registerFrames[7][35] = {0};
 uint32_t registerBuffer = 0;
 
-GFXcanvas1 frameBuffer(37, 7);
+// Dot state, one byte per column as with the driver boards' stateBuffer.
+// dotState is what the dots show once the sweep in progress ends; pendingState
+// is what they will show after the frame waiting to be swept, if it gets to run.
+#define FULL_REFRESH_MS 60000   // re-pulse every dot now and then in case one missed a flip
+uint8_t dotState[7][5] = {0};
+uint8_t pendingState[7][5] = {0};
+bool fullRefresh = true;        // dot state is unknown at power up
+bool pendingFull = false;       // the frame waiting to be swept is a full refresh
+unsigned long lastFullRefresh = 0;
+
+PackedFrame frameBuffer(DISPLAY_WIDTH, DISPLAY_HEIGHT);  // frame being packed by updateDisplay()
 
 class clockFace {
   public:
@@ -114,64 +144,374 @@ void registerSet(int segmentX, int segmentY, bool segmentValue) {
   }
 }
 
-// Generate register states to update module
-void genStates(int module) {
+// Generate register states for the dots of a module that differ from dotState, packed from slot 0
+// Returns the number of slots used
+int genStates(int module, bool full) {
+  int slots = 0;
   for (int sweep = 0; sweep < 5; sweep++) {
+    uint8_t column = 0;
     for (int step = 0; step < 7; step++) {
       bool segmentValue = frameBuffer.getPixel((6-module)*5 + sweep, step);
+      column |= segmentValue << step;
+      if (!full && bitRead(dotState[module][sweep], step) == segmentValue) {
+        continue;
+      }
       int segmentX = sweep;
       int segmentY = step;
       registerSet (segmentX, segmentY, segmentValue);
-      registerFrames[module][sweep*7 + step] = registerBuffer;
+      registerFrames[module][slots] = registerBuffer;
       registerBuffer = 0;
+      slots ++;
     }
+    pendingState[module][sweep] = column;
   } 
-  
+  return slots;
 }
 
-// Shift 32 bits to registers in 8 bit chunks
-void shift32(uint32_t registerFrame) {
-  SPI.transfer((registerFrame & 0xff000000) >> 24);
-  SPI.transfer((registerFrame & 0x00ff0000) >> 16);
-  SPI.transfer((registerFrame & 0x0000ff00) >> 8);
-  SPI.transfer((registerFrame & 0x000000ff));
+// Pulse engine
+// Each slot the words for all modules are shifted in by DMA while the last
+// latch holds, then the timer ISR latches them to energise the coils and, a
+// pulse time later, latches a zero block to release them. The ISR only
+// pulses RCLK and wakes a high priority task that queues the next transfer,
+// so the CPU is free while a sweep runs. Frames are double buffered: the
+// sweep reads one while updateDisplay() packs the other.
+int pulseTime = 300;    // us the coils are energised
+int pulsePeriod = 500;  // us per slot
+
+uint8_t* pulseFrames[2];
+int pulseSlots[2] = {0};  // slots each frame needs - the most changed dots on any one module
+uint8_t* pulseZeros;
+volatile uint8_t activeFrame = 0;
+volatile bool framePending = false;
+SemaphoreHandle_t frameMutex;
+SemaphoreHandle_t frameReady;
+
+hw_timer_t* pulseTimer = NULL;
+spi_device_handle_t pulseSpi;
+TaskHandle_t pulseTaskHandle;
+volatile bool sweepActive = false;
+volatile bool shiftReady = false;
+volatile bool energised = false;
+volatile uint32_t pulseUnderruns = 0;  // latches put off because a transfer was still running
+
+void IRAM_ATTR onPulseTimer() {
+  if (!sweepActive) {
+    return;
+  }
+  if (!shiftReady) {  // never latch a half shifted chain
+    pulseUnderruns ++;
+    timerAlarmWrite(pulseTimer, PULSE_RETRY_US, true);
+    return;
+  }
+  GPIO.out_w1ts = 1 << RCLK_PIN;
+  GPIO.out_w1tc = 1 << RCLK_PIN;
+  shiftReady = false;
+  energised = !energised;
+  timerAlarmWrite(pulseTimer, energised ? pulseTime : pulsePeriod - pulseTime, true);
+
+  BaseType_t woken = pdFALSE;
+  vTaskNotifyGiveFromISR(pulseTaskHandle, &woken);
+  if (woken) {
+    portYIELD_FROM_ISR();
+  }
 }
 
-// Cycle SCLK pin
-void clockRegisters() {
-  digitalWrite(5, HIGH);
-  digitalWrite(5, LOW);
+// Shift one slot's words into the chain - blocks this task, not the CPU
+void shiftSlot(const uint8_t* words) {
+  spi_transaction_t transaction = {};
+  transaction.length = SLOT_BYTES * 8;
+  transaction.tx_buffer = words;
+  spi_device_transmit(pulseSpi, &transaction);
+  shiftReady = true;
 }
 
-void updateDisplay(int saturationTime = 2, int flipTime = 5) {
-  
+void pulseTask(void* pvParameters) {
+  while (true) {
+    if (!framePending) {
+      xSemaphoreTake(frameReady, portMAX_DELAY);
+      continue;
+    }
+    xSemaphoreTake(frameMutex, portMAX_DELAY);
+    activeFrame ^= 1;
+    framePending = false;
+    memcpy(dotState, pendingState, sizeof(dotState));  // committed once its sweep starts
+    int slots = pulseSlots[activeFrame];
+    xSemaphoreGive(frameMutex);
+    const uint8_t* frame = pulseFrames[activeFrame];
+    if (!slots) {
+      continue;
+    }
+
+    energised = false;
+    shiftSlot(frame);
+    sweepActive = true;
+    timerWrite(pulseTimer, 0);
+    timerAlarmWrite(pulseTimer, PULSE_RETRY_US, true);
+    timerAlarmEnable(pulseTimer);
+    for (int slot = 0; slot < slots; slot ++) {
+      ulTaskNotifyTake(pdTRUE, portMAX_DELAY);  // energised
+      shiftSlot(pulseZeros);
+      ulTaskNotifyTake(pdTRUE, portMAX_DELAY);  // released
+      if (slot + 1 < slots) {
+        shiftSlot(frame + (slot + 1) * SLOT_BYTES);
+      }
+    }
+    sweepActive = false;
+    timerAlarmDisable(pulseTimer);
+  }
+}
+
+void setPulseTiming(int pulse, int period) {
+  pulsePeriod = period;
+  pulseTime = constrain(pulse, 1, period - PULSE_MIN_RECOVERY_US);
+}
+
+void beginPulseEngine() {
+  pinMode(RCLK_PIN, OUTPUT);
+  digitalWrite(RCLK_PIN, LOW);
+
+  for (int i = 0; i < 2; i++) {
+    pulseFrames[i] = (uint8_t*)heap_caps_calloc(FRAME_BYTES, 1, MALLOC_CAP_DMA);
+  }
+  pulseZeros = (uint8_t*)heap_caps_calloc(SLOT_BYTES, 1, MALLOC_CAP_DMA);
+  frameMutex = xSemaphoreCreateMutex();
+  frameReady = xSemaphoreCreateBinary();
+
+  spi_bus_config_t bus = {};
+  bus.mosi_io_num = SPI_MOSI_PIN;
+  bus.miso_io_num = -1;
+  bus.sclk_io_num = SPI_SCK_PIN;
+  bus.quadwp_io_num = -1;
+  bus.quadhd_io_num = -1;
+  bus.max_transfer_sz = SLOT_BYTES;
+  spi_bus_initialize(VSPI_HOST, &bus, SPI_DMA_CH_AUTO);
+
+  spi_device_interface_config_t device = {};
+  device.mode = 0;
+  device.clock_speed_hz = SPI_CLOCK_HZ;
+  device.spics_io_num = -1;  // the chain latches on RCLK, not a chip select
+  device.queue_size = 1;
+  spi_bus_add_device(VSPI_HOST, &device, &pulseSpi);
+
+  // Release whatever the registers powered up with
+  shiftSlot(pulseZeros);
+  GPIO.out_w1ts = 1 << RCLK_PIN;
+  GPIO.out_w1tc = 1 << RCLK_PIN;
+  shiftReady = false;
+
+  pulseTimer = timerBegin(0, 80, true);  // 1us ticks
+  timerAttachInterrupt(pulseTimer, &onPulseTimer, true);
+
+  xTaskCreatePinnedToCore (
+    pulseTask,
+    "pulseTask",
+    2048,
+    NULL,
+    configMAX_PRIORITIES - 1,
+    &pulseTaskHandle,
+    1
+  );
+}
+
+// Request a full refresh with the next frame
+void forceFullRefresh() {
+  fullRefresh = true;
+}
+
+// Pack the changed dots for the next sweep and return - the engine picks up the latest frame when the current sweep ends
+// A frame replaced before its sweep started is diffed again from dotState, so none of its changes are lost
+void updateDisplay(const PackedFrame& frame) {
+  if (!frameMutex) {  // scroller tasks can render before setup() has started the engine
+    return;
+  }
+  xSemaphoreTake(frameMutex, portMAX_DELAY);
+  frameBuffer = frame;
+  bool full = fullRefresh || (framePending && pendingFull);
+  fullRefresh = false;
+  pendingFull = full;
+  if (full) {
+    lastFullRefresh = millis();
+  }
+
+  uint8_t* pulseFrame = pulseFrames[activeFrame ^ 1];
+  int moduleSlots[7];
+  int slots = 0;
   for (int module = 6; module >= 0; module --) {
-    genStates(module);
+    moduleSlots[module] = genStates(module, full);
+    slots = max(slots, moduleSlots[module]);
+  }
+  for (int registerFrame = 0; registerFrame < slots; registerFrame ++) {
+    uint8_t* words = pulseFrame + registerFrame * SLOT_BYTES;
+    for (int module = 6; module >= 0; module--) {  // first shifted ends up furthest down the chain
+      uint32_t registerState = registerFrame < moduleSlots[module] ? registerFrames[module][registerFrame] : 0;
+      *words++ = registerState >> 24;
+      *words++ = registerState >> 16;
+      *words++ = registerState >> 8;
+      *words++ = registerState;
+    }
   }
+  pulseSlots[activeFrame ^ 1] = slots;
+  framePending = true;
+  xSemaphoreGive(frameMutex);
+  xSemaphoreGive(frameReady);
+}
 
-  for (int registerFrame = 0; registerFrame < 35; registerFrame ++) {
-    for (int module = 6; module >= 0; module--) {
-      shift32(registerFrames[module][registerFrame]);
+// The direct drive chain as a display backend
+class PulseBackend: public DisplayBackend {
+public:
+  void present(const PackedFrame& frame, const Damage& damage) {
+    if (millis() - lastFullRefresh >= FULL_REFRESH_MS) {  // due even if nothing changed
+      forceFullRefresh();
     }
-    clockRegisters();
-    delayMicroseconds(saturationTime);
-    for (int i = 0; i < 8; i++) {
-      shift32(0x00); 
+    if (damage.empty() && !fullRefresh) {  // the dots already show it
+      return;
     }
-    clockRegisters();
-    delayMicroseconds(flipTime - saturationTime);
+    updateDisplay(frame);
   }
-  for (int i = 0; i < 8; i++) {
-    shift32(0x00); 
+};
+
+PulseBackend pulseBackend;
+BackendGroup backends;
+
+// Animation scheduler
+// One task steps every running animation. They sit in a heap ordered by
+// their next deadline; step() does one frame of work and returns the delay
+// to the next one in us, or 0 once the animation has finished.
+class Animation {
+  friend class AnimationScheduler;
+  int64_t deadline = 0;
+  int64_t restartAt = 0;
+  bool scheduled = false;
+  bool restart = false;  // started again while its step was running
+
+public:
+  Animation() {}
+  Animation(const Animation&) {}
+  Animation& operator=(const Animation&) { return *this; }  // scheduling state belongs to the object, not its value
+  virtual ~Animation() {}
+
+  virtual uint32_t step() = 0;
+};
+
+class AnimationScheduler {
+  std::vector<Animation*> heap;
+  Animation* stepping = NULL;
+  SemaphoreHandle_t mutex;
+  TaskHandle_t taskHandle = NULL;
+
+  static bool later(Animation* a, Animation* b) {
+    return a->deadline > b->deadline;
+  }
+
+  void remove(Animation* animation) {
+    auto it = std::find(heap.begin(), heap.end(), animation);
+    if (it != heap.end()) {
+      heap.erase(it);
+      std::make_heap(heap.begin(), heap.end(), later);
+    }
   }
-  clockRegisters();
-}
+
+  static void run(void* pvParameters) {
+    AnimationScheduler* scheduler = (AnimationScheduler*)pvParameters;
+    while (true) {
+      xSemaphoreTake(scheduler->mutex, portMAX_DELAY);
+      if (scheduler->heap.empty()) {
+        xSemaphoreGive(scheduler->mutex);
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        continue;
+      }
+      Animation* animation = scheduler->heap.front();
+      int64_t now = esp_timer_get_time();
+      if (animation->deadline > now) {
+        xSemaphoreGive(scheduler->mutex);
+        TickType_t ticks = (animation->deadline - now + portTICK_PERIOD_MS * 1000 - 1) / (portTICK_PERIOD_MS * 1000);
+        ulTaskNotifyTake(pdTRUE, ticks);  // a newly started animation may be due sooner
+        continue;
+      }
+      std::pop_heap(scheduler->heap.begin(), scheduler->heap.end(), later);
+      scheduler->heap.pop_back();
+      scheduler->stepping = animation;
+      xSemaphoreGive(scheduler->mutex);
+
+      uint32_t delay = animation->step();
+
+      xSemaphoreTake(scheduler->mutex, portMAX_DELAY);
+      scheduler->stepping = NULL;
+      if (animation->scheduled && (delay || animation->restart)) {
+        if (delay) {
+          animation->deadline += delay;
+          if (animation->deadline < now) {  // fell behind, don't try to catch up
+            animation->deadline = now + delay;
+          }
+        }
+        if (animation->restart && (!delay || animation->restartAt < animation->deadline)) {
+          animation->deadline = animation->restartAt;  // the step may have missed what it was started for
+        }
+        scheduler->heap.push_back(animation);
+        std::push_heap(scheduler->heap.begin(), scheduler->heap.end(), later);
+      } else {
+        animation->scheduled = false;
+      }
+      animation->restart = false;
+      xSemaphoreGive(scheduler->mutex);
+    }
+  }
+
+public:
+  AnimationScheduler() {
+    mutex = xSemaphoreCreateMutex();
+  }
+
+  void begin() {
+    xTaskCreatePinnedToCore (
+      run,
+      "animationScheduler",
+      4096,
+      this,
+      1,
+      &taskHandle,
+      0
+    );
+  }
+
+  // Step the animation after delay us, or right away - restarting a queued animation keeps its place
+  void start(Animation* animation, uint32_t delay = 0) {
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    int64_t at = esp_timer_get_time() + delay;
+    if (animation == stepping) {  // requeued when the step returns, even if it says it's done
+      if (!animation->restart || at < animation->restartAt) {
+        animation->restartAt = at;
+      }
+      animation->scheduled = true;
+      animation->restart = true;
+    } else if (!animation->scheduled) {
+      animation->scheduled = true;
+      animation->deadline = at;
+      heap.push_back(animation);
+      std::push_heap(heap.begin(), heap.end(), later);
+    }
+    xSemaphoreGive(mutex);
+    if (taskHandle) {
+      xTaskNotifyGive(taskHandle);
+    }
+  }
+
+  void stop(Animation* animation) {
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    animation->scheduled = false;
+    animation->restart = false;
+    remove(animation);
+    xSemaphoreGive(mutex);
+  }
+};
+
+AnimationScheduler animations;
 
 class horizontalScroller;
 
 void renderToDisplay();
 
-class verticalScroller {
+class verticalScroller: public Animation {
   private:
     navNode* node;
     horizontalScroller* parentScroller;
@@ -187,60 +527,43 @@ class verticalScroller {
     int evenBufferPos;
     int oddBufferPos;
 
-
-TaskHandle_t animatorHandle;
-
-    static void verticalAnimator(void* pvParameters) {
-      verticalScroller* scroller = (verticalScroller*)pvParameters;
-      bool animating = false;
-      while (true) { // TODO optimise lol
-      Serial.println("Animator loop");
-        if (scroller->position < scroller->animation.targetPos) {
-          scroller->position ++;
-          animating = true;
-          if (scroller->position % SCROLL_CANVAS_HEIGHT == 1) {
-            if ((scroller->position / SCROLL_CANVAS_HEIGHT) % 2) {
-              scroller->drawBuffer(&(scroller->evenBuffer), (scroller->position / SCROLL_CANVAS_HEIGHT) + 1);
-              scroller->evenBufferPos = (scroller->position / SCROLL_CANVAS_HEIGHT) + 1;
-            }
-            else {
-              scroller->drawBuffer(&(scroller->oddBuffer), (scroller->position / SCROLL_CANVAS_HEIGHT) + 1);
-              scroller->oddBufferPos = (scroller->position / SCROLL_CANVAS_HEIGHT) + 1;
-            }
+    uint32_t step() {
+      if (position < animation.targetPos) {
+        position ++;
+        if (position % SCROLL_CANVAS_HEIGHT == 1) {
+          if ((position / SCROLL_CANVAS_HEIGHT) % 2) {
+            drawBuffer(&evenBuffer, (position / SCROLL_CANVAS_HEIGHT) + 1);
+            evenBufferPos = (position / SCROLL_CANVAS_HEIGHT) + 1;
           }
-        }
-        else if (scroller->position > scroller->animation.targetPos) {
-          scroller->position --;
-          animating = true;
-          if (scroller->position % SCROLL_CANVAS_HEIGHT == 7) {
-            if ((scroller->position / SCROLL_CANVAS_HEIGHT) % 2) {
-              scroller->drawBuffer(&(scroller->oddBuffer), (scroller->position / SCROLL_CANVAS_HEIGHT));
-              scroller->oddBufferPos = (scroller->position / SCROLL_CANVAS_HEIGHT);
-            }
-            else {
-              scroller->drawBuffer(&(scroller->evenBuffer), (scroller->position / SCROLL_CANVAS_HEIGHT) );
-              scroller->evenBufferPos = (scroller->position / SCROLL_CANVAS_HEIGHT);
-            }
+          else {
+            drawBuffer(&oddBuffer, (position / SCROLL_CANVAS_HEIGHT) + 1);
+            oddBufferPos = (position / SCROLL_CANVAS_HEIGHT) + 1;
           }
         }
-        else {
-          if (animating) {
-            animating = false;
-            scroller->animation.startingPos=scroller->position;
-            renderToDisplay();
-            Serial.println("Animation complete");
+      }
+      else if (position > animation.targetPos) {
+        position --;
+        if (position % SCROLL_CANVAS_HEIGHT == 7) {
+          if ((position / SCROLL_CANVAS_HEIGHT) % 2) {
+            drawBuffer(&oddBuffer, (position / SCROLL_CANVAS_HEIGHT));
+            oddBufferPos = (position / SCROLL_CANVAS_HEIGHT);
+          }
+          else {
+            drawBuffer(&evenBuffer, (position / SCROLL_CANVAS_HEIGHT) );
+            evenBufferPos = (position / SCROLL_CANVAS_HEIGHT);
           }
         }
+      }
 
-        if (animating) {
-          scroller->updatetest();
-          float remainingDistance = abs(scroller->animation.targetPos - scroller->position);
-          delayMicroseconds(constrain(50000.0/remainingDistance, 100, 5000000));
-        }
-        else {
-          vTaskDelay(10/portTICK_PERIOD_MS );
-        }
+      if (position == animation.targetPos) {
+        animation.startingPos = position;
+        renderToDisplay();
+        return 0;
       }
+
+      updatetest();
+      float remainingDistance = abs(animation.targetPos - position);
+      return constrain(50000.0/remainingDistance, 100, 5000000);
     }
 
     verticalScroller(navNode *nodePointer, horizontalScroller *parentPointer)
@@ -260,25 +583,16 @@ TaskHandle_t animatorHandle;
       oddBuffer.setFont(&Font5x7Fixed);
       oddBuffer.setCursor(0, 7);
       oddBuffer.print("odd");
-
-      xTaskCreatePinnedToCore (
-        verticalAnimator,
-        "verticalAnimator",
-        1000,
-        this,
-        1,
-        &animatorHandle,
-        0
-      );
     }
 
     ~verticalScroller() {
       Serial.println("destroying scroller");
-      vTaskDelete(animatorHandle);
+      animations.stop(this);
     }
 
     void verticalAnimation(int toY) {
       animation.targetPos = toY;
+      animations.start(this);
     }
 
     void drawBuffer(GFXcanvas1* buffer, int row) {
@@ -316,7 +630,7 @@ TaskHandle_t animatorHandle;
     }
 };
 
-class horizontalScroller {
+class horizontalScroller: public Animation {
   private:
   navRoot* root;
 
@@ -335,55 +649,50 @@ class horizontalScroller {
     bool animationCompleted = true;
 
 
-    static void horizontalAnimator(void* pvParameters) {
-      horizontalScroller* scroller = (horizontalScroller*)pvParameters;
-      scroller->animationCompleted = false;
-      while (true) { // TODO optimise lol
-        if (scroller->position < scroller->animation.targetPos) {
-          scroller->position ++;
-          if (scroller->position % SCROLL_CANVAS_WIDTH == 1) {
-            if ((scroller->position / SCROLL_CANVAS_WIDTH) % 2) {
-              //scroller->drawBuffer(&(scroller->evenBuffer), (scroller->position / SCROLL_CANVAS_WIDTH) + 1); //LOAD NEST SCROLLER
-              scroller->evenScrollerPos = (scroller->position / SCROLL_CANVAS_WIDTH) + 1;
-            }
-            else {
-              //scroller->drawBuffer(&(scroller->oddBuffer), (scroller->position / SCROLL_CANVAS_WIDTH) + 1); //LOAD NEST SCROLLER
-              scroller->oddScrollerPos = (scroller->position / SCROLL_CANVAS_WIDTH) + 1;
-              Serial.println("Update odd buffer");
-              scroller->updateScroller(false);
-            }
+    uint32_t step() {
+      if (position < animation.targetPos) {
+        position ++;
+        if (position % SCROLL_CANVAS_WIDTH == 1) {
+          if ((position / SCROLL_CANVAS_WIDTH) % 2) {
+            //drawBuffer(&evenBuffer, (position / SCROLL_CANVAS_WIDTH) + 1); //LOAD NEST SCROLLER
+            evenScrollerPos = (position / SCROLL_CANVAS_WIDTH) + 1;
           }
-          
-        }
-        else if (scroller->position > scroller->animation.targetPos) {
-          scroller->position --;
-          if (scroller->position % SCROLL_CANVAS_WIDTH == SCROLL_CANVAS_WIDTH-1) {
-            if ((scroller->position / SCROLL_CANVAS_WIDTH) % 2) {
-              //scroller->drawBuffer(&(scroller->oddBuffer), (scroller->position / SCROLL_CANVAS_WIDTH)); //LOAD PREV SCROLLER
-              scroller->oddScrollerPos = (scroller->position / SCROLL_CANVAS_WIDTH);
-            }
-            else {
-              //scroller->drawBuffer(&(scroller->evenBuffer), (scroller->position / SCROLL_CANVAS_WIDTH) );//LOAD PREV SCROLLER
-              scroller->evenScrollerPos = (scroller->position / SCROLL_CANVAS_WIDTH);
-            }
+          else {
+            //drawBuffer(&oddBuffer, (position / SCROLL_CANVAS_WIDTH) + 1); //LOAD NEST SCROLLER
+            oddScrollerPos = (position / SCROLL_CANVAS_WIDTH) + 1;
+            Serial.println("Update odd buffer");
+            updateScroller(false);
           }
         }
-        else {
-          break;
+        
+      }
+      else if (position > animation.targetPos) {
+        position --;
+        if (position % SCROLL_CANVAS_WIDTH == SCROLL_CANVAS_WIDTH-1) {
+          if ((position / SCROLL_CANVAS_WIDTH) % 2) {
+            //drawBuffer(&oddBuffer, (position / SCROLL_CANVAS_WIDTH)); //LOAD PREV SCROLLER
+            oddScrollerPos = (position / SCROLL_CANVAS_WIDTH);
+          }
+          else {
+            //drawBuffer(&evenBuffer, (position / SCROLL_CANVAS_WIDTH) );//LOAD PREV SCROLLER
+            evenScrollerPos = (position / SCROLL_CANVAS_WIDTH);
+          }
         }
+      }
+      else {
+        animationCompleted = true;
+        return 0;
+      }
 
-        scroller->updatetest();
+      updatetest();
 
-        float remainingDistance = abs(scroller->animation.targetPos - scroller->position);
+      float remainingDistance = abs(animation.targetPos - position);
 
-        if (scroller->animation.targetPos - scroller->position == 0) {
-          scroller->animationCompleted  = true;
-        }
-        else {
-          delayMicroseconds(constrain(100000.0/remainingDistance, 0, 5000000));
-        }
+      if (animation.targetPos - position == 0) {
+        animationCompleted  = true;
+        return 0;
       }
-      vTaskDelete(NULL);
+      return constrain(100000.0/remainingDistance, 1, 5000000);
     }
 
     horizontalScroller(navRoot *rootPointer): evenScroller(&nav.path[0], this), oddScroller(&nav.path[1], this) { //TODO pass this to scrollers for later callback function
@@ -415,15 +724,8 @@ class horizontalScroller {
     void horizontalAnimation(int toX) {
       animation.targetPos = toX;
       animation.startingPos = position;
-      xTaskCreatePinnedToCore (
-        horizontalAnimator,
-        "horizontalAnimator",
-        1000,
-        this,
-        1,
-        NULL,
-        0
-      );
+      animationCompleted = false;
+      animations.start(this);
     }
 
     void goTo (int col) {
@@ -457,14 +759,30 @@ void verticalScroller::updatetest() {
 horizontalScroller testScroller(&nav);
 
 void renderToDisplay() {
-  for (int FBY = 0; FBY < 8; FBY ++) {
-    for (int FBX = 0; FBX < 36; FBX ++) {
-      frameBuffer.writePixel(FBX, FBY, testScroller.getPixel(FBX, FBY));
+  PackedFrame frame(DISPLAY_WIDTH, DISPLAY_HEIGHT);
+  for (int FBY = 0; FBY < DISPLAY_HEIGHT; FBY ++) {
+    for (int FBX = 0; FBX < DISPLAY_WIDTH; FBX ++) {
+      frame.setPixel(FBX, FBY, testScroller.getPixel(FBX, FBY));
     }
   }
-  updateDisplay();
+  backends.submit(frame);
 }
 
+// A display left alone submits no frames, so this resubmits once the full refresh is due
+class FullRefreshTimer: public Animation {
+public:
+  uint32_t step() {
+    unsigned long since = millis() - lastFullRefresh;
+    if (since < FULL_REFRESH_MS) {  // a frame on its way took care of it
+      return (FULL_REFRESH_MS - since) * 1000;
+    }
+    renderToDisplay();
+    return FULL_REFRESH_MS * 1000;
+  }
+};
+
+FullRefreshTimer fullRefreshTimer;
+
 /*
 void updateDisplay() {
   
@@ -575,13 +893,10 @@ result idle(menuOut &o, idleEvent e) {
 }
 
 void setup() {
-  pinMode(5, OUTPUT);
-
-  for (int i = 0; i < 8; i++) {
-    shift32(0x00); 
-  }
-
-  SPI.begin();
+  beginPulseEngine();
+  backends.add(&pulseBackend);
+  animations.begin();
+  animations.start(&fullRefreshTimer, FULL_REFRESH_MS * 1000);
   Serial.begin(112500);
 
   nav.idleTask=idle;
@@ -0,0 +1,170 @@
+/*
+
+  DisplayBackend.cpp - Packed frames and the outputs that show them.
+
+*/
+
+#include "DisplayBackend.h"
+
+PackedFrame::PackedFrame(uint8_t width, uint8_t height)
+: width(width < PACKED_FRAME_MAX_COLUMNS ? width : PACKED_FRAME_MAX_COLUMNS)
+, height(height < 8 ? height : 8) {}
+
+LogicalFrame::LogicalFrame(uint8_t width, uint8_t height)
+: width(width < PACKED_FRAME_MAX_COLUMNS ? width : PACKED_FRAME_MAX_COLUMNS)
+, height(height < LOGICAL_FRAME_MAX_BANDS * 8 ? height : LOGICAL_FRAME_MAX_BANDS * 8) {}
+
+void transpose8(const uint8_t* in, uint8_t* out) {
+  // Hacker's Delight works on rows with the first column in the MSB, so feed the tile in reversed
+  uint32_t x = (uint32_t)in[7] << 24 | (uint32_t)in[6] << 16 | (uint32_t)in[5] << 8 | in[4];
+  uint32_t y = (uint32_t)in[3] << 24 | (uint32_t)in[2] << 16 | (uint32_t)in[1] << 8 | in[0];
+  uint32_t t;
+
+  t = (x ^ (x >> 7)) & 0x00AA00AA;  x = x ^ t ^ (t << 7);
+  t = (y ^ (y >> 7)) & 0x00AA00AA;  y = y ^ t ^ (t << 7);
+
+  t = (x ^ (x >> 14)) & 0x0000CCCC;  x = x ^ t ^ (t << 14);
+  t = (y ^ (y >> 14)) & 0x0000CCCC;  y = y ^ t ^ (t << 14);
+
+  t = (x & 0xF0F0F0F0) | ((y >> 4) & 0x0F0F0F0F);
+  y = ((x << 4) & 0xF0F0F0F0) | (y & 0x0F0F0F0F);
+  x = t;
+
+  out[7] = x >> 24;  out[6] = x >> 16;  out[5] = x >> 8;  out[4] = x;
+  out[3] = y >> 24;  out[2] = y >> 16;  out[1] = y >> 8;  out[0] = y;
+}
+
+void orientFrame(const LogicalFrame& logical, const Orientation& orientation, PackedFrame& panel) {
+  bool transposed = orientation.transposed();
+  bool flipX = (orientation.rotation == 1 || orientation.rotation == 2) != orientation.mirror;
+  bool flipY = (orientation.rotation == 2 || orientation.rotation == 3);
+
+  panel = PackedFrame(transposed ? logical.height : logical.width, transposed ? logical.width : logical.height);
+  if (transposed) {  // logical rows become panel columns
+    uint8_t tile[8];
+    for (uint8_t band = 0; band * 8 < panel.width; band++) {
+      for (uint8_t x = 0; x < 8; x++) {
+        tile[x] = x < logical.width ? logical.bands[band][x] : 0;
+      }
+      uint8_t columns = panel.width - band * 8 < 8 ? panel.width - band * 8 : 8;
+      uint8_t transposedTile[8];
+      transpose8(tile, transposedTile);
+      memcpy(&panel.columns[band * 8], transposedTile, columns);
+    }
+  } else {
+    memcpy(panel.columns, logical.bands[0], panel.width);
+  }
+
+  if (flipX) {
+    for (uint8_t left = 0, right = panel.width - 1; left < right; left++, right--) {
+      uint8_t column = panel.columns[left];
+      panel.columns[left] = panel.columns[right];
+      panel.columns[right] = column;
+    }
+  }
+  if (flipY) {
+    for (uint8_t x = 0; x < panel.width; x++) {
+      panel.columns[x] = reverse8(panel.columns[x]) >> (8 - panel.height);
+    }
+  }
+}
+
+Damage Damage::all(const PackedFrame& frame) {
+  Damage damage;
+  if (frame.width) {
+    damage.first = 0;
+    damage.last = frame.width - 1;
+  }
+  return damage;
+}
+
+Damage Damage::between(const PackedFrame& previous, const PackedFrame& frame) {
+  if (previous.width != frame.width || previous.height != frame.height) {
+    return all(frame);
+  }
+  Damage damage;
+  uint8_t x = 0;
+  while (x < frame.width && previous.columns[x] == frame.columns[x]) {
+    x ++;
+  }
+  if (x == frame.width) {
+    return damage;
+  }
+  damage.first = x;
+  x = frame.width - 1;
+  while (previous.columns[x] == frame.columns[x]) {
+    x --;
+  }
+  damage.last = x;
+  return damage;
+}
+
+bool BackendGroup::add(DisplayBackend* backend) {
+  if (count == BACKEND_GROUP_MAX) {
+    return false;
+  }
+  backends[count] = backend;
+  count ++;
+  return true;
+}
+
+void BackendGroup::begin() {
+  for (uint8_t i = 0; i < count; i++) {
+    backends[i]->begin();
+  }
+}
+
+void BackendGroup::present(const PackedFrame& frame, const Damage& damage) {
+  for (uint8_t i = 0; i < count; i++) {
+    backends[i]->present(frame, damage);
+  }
+  previous = frame;
+  havePrevious = true;
+}
+
+void BackendGroup::submit(const PackedFrame& frame) {
+  present(frame, havePrevious ? Damage::between(previous, frame) : Damage::all(frame));
+}
+
+#ifdef ARDUINO
+void GFXMirrorBackend::present(const PackedFrame& frame, const Damage& damage) {
+  if (damage.empty()) {
+    return;
+  }
+  uint8_t centre = scale / 2;
+  for (uint8_t x = damage.first; x <= damage.last; x++) {
+    int16_t left = originX + x * scale;
+    gfx.fillRect(left, originY, scale, frame.height * scale, false);
+    for (uint8_t y = 0; y < frame.height; y++) {
+      if (!frame.getPixel(x, y)) {
+        continue;
+      }
+      int16_t top = originY + y * scale;
+      gfx.drawFastHLine(left, top + centre, scale, true);
+      gfx.drawFastVLine(left + centre, top, scale, true);
+    }
+  }
+  if (show) {
+    show();
+  }
+}
+#endif
+
+void FileBackend::present(const PackedFrame& frame, const Damage& damage) {
+  frameCount ++;
+  if (damage.empty() && frameCount > 1) {
+    return;
+  }
+  if (terminal) {
+    fprintf(file, "\x1b[H");
+  } else {
+    fprintf(file, "frame %lu, columns %u-%u\n", (unsigned long)frameCount, damage.first, damage.last);
+  }
+  for (uint8_t y = 0; y < frame.height; y++) {
+    for (uint8_t x = 0; x < frame.width; x++) {
+      fputc(frame.getPixel(x, y) ? '#' : '.', file);
+    }
+    fputc('\n', file);
+  }
+  fflush(file);
+}
@@ -0,0 +1,189 @@
+/*
+
+  DisplayBackend.h - Packed frames and the outputs that show them.
+
+  A render engine packs each frame once into a PackedFrame and hands it,
+  with the columns that changed since the last one, to a DisplayBackend.
+  Backends only deal in packed columns, so none of them need per-pixel
+  access to the element tree. BackendGroup fans one frame out to several.
+
+*/
+
+#ifndef DisplayBackend_h
+#define DisplayBackend_h
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#define PACKED_FRAME_MAX_COLUMNS 48
+#define LOGICAL_FRAME_MAX_BANDS 6
+#define BACKEND_GROUP_MAX 4
+
+// Mirror an 8 bit column top to bottom
+inline uint8_t reverse8(uint8_t b) {
+  b = (b & 0xF0) >> 4 | (b & 0x0F) << 4;
+  b = (b & 0xCC) >> 2 | (b & 0x33) << 2;
+  b = (b & 0xAA) >> 1 | (b & 0x55) << 1;
+  return b;
+}
+
+// Transpose an 8x8 tile of column bytes, out[j] bit i = in[i] bit j - Hacker's Delight 7-3
+void transpose8(const uint8_t* in, uint8_t* out);
+
+// One byte per column, bit y is row y counting from the top - up to 8 rows
+struct PackedFrame {
+  uint8_t width = 0;
+  uint8_t height = 0;
+  uint8_t columns[PACKED_FRAME_MAX_COLUMNS] = {0};
+
+  PackedFrame() {}
+  PackedFrame(uint8_t width, uint8_t height);
+
+  bool getPixel(uint8_t x, uint8_t y) const {
+    return (columns[x] >> y) & 1;
+  }
+
+  void setPixel(uint8_t x, uint8_t y, bool value) {
+    if (value) {
+      columns[x] |= 1 << y;
+    } else {
+      columns[x] &= ~(1 << y);
+    }
+  }
+
+  void clear() {
+    memset(columns, 0, sizeof(columns));
+  }
+};
+
+// Frame as rendered, before orientation - columns in bands of 8 rows, so it can be taller than a panel
+struct LogicalFrame {
+  uint8_t width = 0;
+  uint8_t height = 0;
+  uint8_t bands[LOGICAL_FRAME_MAX_BANDS][PACKED_FRAME_MAX_COLUMNS] = {{0}};
+
+  LogicalFrame(uint8_t width, uint8_t height);
+
+  bool getPixel(uint8_t x, uint8_t y) const {
+    return (bands[y >> 3][x] >> (y & 7)) & 1;
+  }
+
+  void setPixel(uint8_t x, uint8_t y, bool value) {
+    if (value) {
+      bands[y >> 3][x] |= 1 << (y & 7);
+    } else {
+      bands[y >> 3][x] &= ~(1 << (y & 7));
+    }
+  }
+};
+
+// How the panels are mounted - quarter turns clockwise, then a left-right mirror
+struct Orientation {
+  uint8_t rotation = 0;
+  bool mirror = false;
+
+  bool transposed() const {
+    return rotation & 1;
+  }
+
+  // Logical frame size for a panel of the given size
+  uint8_t logicalWidth(uint8_t panelWidth, uint8_t panelHeight) const {
+    return transposed() ? panelHeight : panelWidth;
+  }
+
+  uint8_t logicalHeight(uint8_t panelWidth, uint8_t panelHeight) const {
+    return transposed() ? panelWidth : panelHeight;
+  }
+};
+
+// Rotate and mirror a whole frame onto the panel, 8x8 tiles and columns at a time
+// Rotated frames must be at most 8 wide, unrotated ones at most 8 tall
+void orientFrame(const LogicalFrame& logical, const Orientation& orientation, PackedFrame& panel);
+
+// Columns first to last (inclusive) changed - empty when first > last
+struct Damage {
+  uint8_t first = 1;
+  uint8_t last = 0;
+
+  bool empty() const {
+    return first > last;
+  }
+
+  bool contains(uint8_t x) const {
+    return x >= first && x <= last;
+  }
+
+  static Damage all(const PackedFrame& frame);
+  static Damage between(const PackedFrame& previous, const PackedFrame& frame);
+};
+
+class DisplayBackend {
+public:
+  virtual ~DisplayBackend() {}
+
+  virtual void begin() {}
+
+  // Show a frame, damage says which columns differ from the previous one presented
+  virtual void present(const PackedFrame& frame, const Damage& damage) = 0;
+};
+
+// Presents each frame to every backend added, working out the damage once
+class BackendGroup: public DisplayBackend {
+  DisplayBackend* backends[BACKEND_GROUP_MAX];
+  uint8_t count = 0;
+  PackedFrame previous;
+  bool havePrevious = false;
+
+public:
+  bool add(DisplayBackend* backend);
+
+  void begin();
+
+  void present(const PackedFrame& frame, const Damage& damage);
+
+  // Present a frame, damaged against the one submitted before it
+  void submit(const PackedFrame& frame);
+
+  // Treat the next frame as all new, e.g. after the displays were cleared
+  void invalidate() {
+    havePrevious = false;
+  }
+};
+
+#ifdef ARDUINO
+#include <Adafruit_GFX.h>
+
+// Mirror on any Adafruit GFX display, each dot drawn as a plus like the old
+// OLED_DISPLAY code did on the SSD1306. show is called after drawing, for
+// displays that need pushing, e.g. [](){ oled.display(); }
+class GFXMirrorBackend: public DisplayBackend {
+  Adafruit_GFX& gfx;
+  void (*show)();
+  uint8_t scale;
+  int16_t originX;
+  int16_t originY;
+
+public:
+  GFXMirrorBackend(Adafruit_GFX& gfx, void (*show)() = NULL, uint8_t scale = 3, int16_t originX = 0, int16_t originY = 0)
+  : gfx(gfx), show(show), scale(scale), originX(originX), originY(originY) {}
+
+  void present(const PackedFrame& frame, const Damage& damage);
+};
+#endif
+
+// Frames as text on a FILE* - a terminal, a log or the serial console.
+// In terminal mode each frame redraws over the last with ANSI cursor moves.
+class FileBackend: public DisplayBackend {
+  FILE* file;
+  bool terminal;
+  uint32_t frameCount = 0;
+
+public:
+  FileBackend(FILE* file, bool terminal = false)
+  : file(file), terminal(terminal) {}
+
+  void present(const PackedFrame& frame, const Damage& damage);
+};
+
+#endif